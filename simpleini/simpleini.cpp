@@ -0,0 +1,4 @@
+// Compiles the common instantiations of simpleini.h once, see
+// SIMPLEINI_LIBRARY.
+#define SIMPLEINI_IMPLEMENTATION
+#include "simpleini.h"
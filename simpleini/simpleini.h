@@ -2,16 +2,82 @@
 #define SIMPLEINI_H
 
 #include <map>
+#include <set>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cfloat>
+#include <clocale>
+#include <cerrno>
 #include <sstream>
 #include <fstream>
 #include <limits>
 #include <vector>
 #include <list>
+#include <algorithm>
+#include <ostream>
+#include <memory>
+#include <new>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <type_traits>
+
+#include <atomic>
+#include <chrono>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#endif
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
+
+#include <sys/stat.h>
+
+#ifdef SIMPLEINI_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef SIMPLEINI_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+// std::string_view lookups change the signatures and map comparators, so a
+// compiled library and its users must agree on them; the simpleini CMake
+// target defines SIMPLEINI_NO_STRING_VIEW for users when built before C++17.
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <string_view>
+#if !defined(SIMPLEINI_NO_STRING_VIEW)
+#define SIMPLEINI_STRING_VIEW
+#endif
+#endif
+
+#if __cplusplus >= 201402L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+#include <shared_mutex>
+#endif
 
 #define SIMPLEINI_VERSION_MAJOR 1
 #define SIMPLEINI_VERSION_MINOR 0
 #define SIMPLEINI_VERSION "1.0"
 
+// Arrays of numbers with at least this many elements are kept in native form
+#ifndef SIMPLEINI_NATIVE_ARRAY_SIZE
+#define SIMPLEINI_NATIVE_ARRAY_SIZE 1024
+#endif
+
+// Included files kept parsed for later loads, least recently used dropped
+#ifndef SIMPLEINI_INCLUDE_CACHE_SIZE
+#define SIMPLEINI_INCLUDE_CACHE_SIZE 64
+#endif
+
 namespace simpleini
 {
 
@@ -21,6 +87,11 @@ template <typename>
 class Raw;
 }
 
+class Value;
+
+template <typename R, typename W>
+class ConfigImpl;
+
 namespace traits
 {
     template <bool, bool>
@@ -88,6 +159,45 @@ namespace traits
     using enable_bool = typename std::enable_if<
             is_bool<T>::value, T
         >::type;
+
+    template <typename T>
+    struct is_native_array : std::false_type { };
+
+    template <typename T>
+    struct is_native_array<std::vector<T>> : std::integral_constant<bool,
+            (is_integral<T>::value && !is_bool<T>::value) || is_floating_point<T>::value
+        > { };
+
+    template <typename T>
+    using disable_value = typename std::enable_if<
+            !std::is_base_of<Value, typename remove_cvref<T>::type>::value
+        >::type;
+
+    template <typename R>
+    struct has_line_view
+    {
+        template <typename U>
+        static auto test(U* u) -> decltype(u->getLine(std::declval<const char*&>(), std::declval<size_t&>()), std::true_type{});
+
+        template <typename>
+        static std::false_type test(...);
+
+        using type = decltype(test<R>(nullptr));
+        static constexpr bool value = type::value;
+    };
+
+    template <typename W>
+    struct has_close
+    {
+        template <typename U>
+        static auto test(U* u) -> decltype(u->close(), std::true_type{});
+
+        template <typename>
+        static std::false_type test(...);
+
+        using type = decltype(test<W>(nullptr));
+        static constexpr bool value = type::value;
+    };
 }
 
 namespace utils
@@ -96,72 +206,126 @@ namespace utils
     class Raw
     {
     public:
-        Raw(const std::string& raw = {})
-            : m_value{raw}
+        Raw(std::string raw = {})
+            : m_value{std::move(raw)}
         { }
 
         inline const std::string& value() const
         {
             return m_value;
         }
+
+        inline std::string take()
+        {
+            return std::move(m_value);
+        }
     private:
         std::string m_value;
     };
 
-    constexpr bool Encode = true;
-    constexpr bool Decode = false;
+    inline const char* escape(char c)
+    {
+        switch (c)
+        {
+        case '\n': return "\\n";
+        case '\t': return "\\t";
+        case '\r': return "\\r";
+        case '\"': return "\\\"";
+        default: return nullptr;
+        }
+    }
 
-    template <typename = void>
-    std::string transcode_text(std::string text, bool encode)
+    inline char unescape(char c)
     {
-        const std::map<std::string, std::string> table
+        switch (c)
         {
-            {"\n", "\\n"},
-            {"\t", "\\t"},
-            {"\"", "\\\""},
-            {"\r", "\\r"}
-        };
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case '\"': return '\"';
+        default: return '\0';
+        }
+    }
 
-        if (!text.empty())
+    template <typename = void>
+    std::string encode_text(const std::string& text)
+    {
+        std::string out;
+        out.reserve(text.size() + 2);
+        out.push_back('\"');
+        for (char c : text)
         {
-            for (const auto& kv : table)
+            const char* escaped = escape(c);
+            if (escaped != nullptr)
             {
-                size_t size = encode ? kv.first.size() : kv.second.size();
-                size_t pos { 0 };
-                while (pos <= text.size() - 1)
-                {
-                    pos = text.find(encode ? kv.first : kv.second, pos);
-                    if (pos == std::string::npos)
-                    {
-                        break;
-                    }
-                    text.replace(pos, size, encode ? kv.second : kv.first);
-                    pos += encode ? kv.second.size() : kv.first.size();
-                }
+                out.append(escaped, 2);
+            }
+            else
+            {
+                out.push_back(c);
             }
         }
-        if (encode)
-        {
-            text.insert(0, "\"");
-            text.append("\"");
-        }
-        else
+        out.push_back('\"');
+        return out;
+    }
+
+    // Unescapes text[0, size) into out, which may alias text. Quotes around
+    // the unescaped text are dropped. Returns the size of the decoded text.
+    inline size_t decode_into(const char* text, size_t size, char* out)
+    {
+        size_t n { 0 };
+        bool first { true };
+        for (size_t i = 0; i < size; ++i)
         {
-            if (!text.empty() && text[0] == '\"')
+            char c = text[i];
+            if (c == '\\' && i + 1 < size && unescape(text[i + 1]) != '\0')
             {
-                text.replace(0, 1, "");
+                c = unescape(text[++i]);
             }
-            if (!text.empty() && text[text.size() - 1] == '\"')
+            if (first && c == '\"')
             {
-                text.replace(text.size() - 1, 1, "");
+                first = false;
+                continue;
             }
+            first = false;
+            out[n++] = c;
+        }
+        if (n > 0 && out[n - 1] == '\"')
+        {
+            --n;
+        }
+        return n;
+    }
+
+    template <typename = void>
+    std::string decode_text(const std::string& text)
+    {
+        if (text.find('\\') == std::string::npos)
+        {
+            size_t b = !text.empty() && text.front() == '\"' ? 1 : 0;
+            size_t e = text.size() > b && text.back() == '\"' ? text.size() - 1 : text.size();
+            return text.substr(b, e - b);
         }
+        std::string out(text.size(), '\0');
+        out.resize(decode_into(text.data(), text.size(), &out[0]));
+        return out;
+    }
 
-        return text;
+    template <typename = void>
+    std::string decode_text(std::string&& text)
+    {
+        if (!text.empty())
+        {
+            text.resize(decode_into(text.data(), text.size(), &text[0]));
+        }
+        return std::move(text);
     }
 
+    // Positions [first, second) of the elements of an array raw value.
+    using ArrayIndex = std::vector<std::pair<size_t, size_t>>;
+
     template <typename = void>
-    std::vector<std::string> splitArray(const std::string& array)
+    ArrayIndex index_array(const std::string& array)
     {
         auto findStringEnd = [](const std::string& str, size_t pos)
         {
@@ -181,7 +345,7 @@ namespace utils
         {
             return {};
         }
-        std::vector<std::string> values;
+        ArrayIndex items;
         size_t pos = b + 1;
         for (; pos < array.size();)
         {
@@ -216,22 +380,38 @@ namespace utils
             {
                 ++end;
             }
-            values.push_back(array.substr(pos, end - pos));
+            items.emplace_back(pos, end);
             pos = end;
         }
+        return items;
+    }
+
+    template <typename = void>
+    std::vector<std::string> splitArray(const std::string& array)
+    {
+        std::vector<std::string> values;
+        for (const auto& item : index_array(array))
+        {
+            values.push_back(array.substr(item.first, item.second - item.first));
+        }
         return values;
     }
 
     template <typename T>
     std::string to_raw_value(T value, traits::enable_raw<T>* = nullptr)
     {
-        return value.value();
+        return value.take();
     }
 
     template <typename T>
     std::string to_raw_value(T value, traits::enable_text<T>* = nullptr)
     {
-        return transcode_text(value, utils::Encode);
+        return encode_text(value);
+    }
+
+    inline std::string to_raw_value(const std::string& value)
+    {
+        return encode_text(value);
     }
 
     template <typename T>
@@ -293,6 +473,12 @@ namespace utils
         return T{raw};
     }
 
+    template <typename T>
+    traits::enable_raw<T> from_raw_value(std::string&& raw)
+    {
+        return T{std::move(raw)};
+    }
+
     template <typename T>
     traits::enable_bool<T> from_raw_value(const std::string& raw)
     {
@@ -321,352 +507,4435 @@ namespace utils
     template <typename T>
     traits::enable_text<T> from_raw_value(const std::string& raw)
     {
-        return utils::transcode_text(raw, utils::Decode);
+        return utils::decode_text(raw);
     }
 
     template <typename T>
-    std::vector<T> from_raw_array(const std::string& raw)
+    traits::enable_text<T> from_raw_value(std::string&& raw)
     {
-        std::vector<T> out;
-        auto vs = utils::splitArray(raw);
-        for (const auto& v : vs)
-        {
-            out.push_back(from_raw_value<T>(v));
-        }
-        return out;
+        return utils::decode_text(std::move(raw));
     }
-}
 
-class Value
-{
-public:
-    template <typename T>
-    Value& operator=(T&& v)
+    // Checks eight ASCII digits at once, bytes in memory order.
+    inline bool eight_digits(uint64_t v)
     {
-        m_raw = utils::to_raw_value(std::forward<T>(v));
-        return *this;
+        return (v & 0xF0F0F0F0F0F0F0F0ULL) == 0x3030303030303030ULL
+            && ((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) == 0x3030303030303030ULL;
     }
 
-    template<typename T>
-    T value(const T& defaultValue = T{}) const
+    // Converts eight ASCII digits loaded little endian with three multiplies.
+    inline uint64_t parse_eight_digits(uint64_t v)
     {
-        return m_raw.empty() ? defaultValue : utils::from_raw_value<T>(m_raw);
+        v -= 0x3030303030303030ULL;
+        v = (v * 10) + (v >> 8);
+        return (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)))
+            + (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
     }
 
-    template <typename T>
-    std::vector<T> array() const
+    inline bool is_digit(char c)
     {
-        return utils::from_raw_array<T>(m_raw);
+        return c >= '0' && c <= '9';
     }
 
-    void clear()
+    // Reads the digits at p into v, eight at a time where possible, and
+    // returns their count.
+    inline size_t read_digits(const char*& p, const char* end, uint64_t& v)
     {
-        m_raw.clear();
+        const char* begin = p;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ || defined(_M_X64) || defined(_M_IX86) || defined(_M_ARM64)
+        while (end - p >= 8)
+        {
+            uint64_t chunk;
+            std::memcpy(&chunk, p, 8);
+            if (!eight_digits(chunk))
+            {
+                break;
+            }
+            v = v * 100000000 + parse_eight_digits(chunk);
+            p += 8;
+        }
+#endif
+        while (p < end && is_digit(*p))
+        {
+            v = v * 10 + static_cast<uint64_t>(*p - '0');
+            ++p;
+        }
+        return static_cast<size_t>(p - begin);
     }
 
-    bool empty() const
+    // Element decoders of the array fast path. They accept the subset of the
+    // text istream would read the same way and return false for anything
+    // else, which sends the whole array to the generic path.
+    template <typename T>
+    bool decode_number(const char*& p, const char* end, T& out, std::integral_constant<int, 1>)
     {
-        return m_raw.empty();
+        using V = typename std::conditional<traits::is_unsigned<T>::value, unsigned long long, long long>::type;
+        bool negative { false };
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p++ == '-';
+        }
+        if (negative && traits::is_unsigned<T>::value)
+        {
+            return false;
+        }
+        uint64_t v { 0 };
+        size_t n = read_digits(p, end, v);
+        if (n == 0 || n > 18)
+        {
+            return false;
+        }
+        out = static_cast<T>(negative ? static_cast<V>(-static_cast<long long>(v)) : static_cast<V>(v));
+        return true;
     }
 
-private:
-    std::string m_raw;
-};
-
-template<uint T>
-class Entry
-{
-};
-
-
-template<>
-class Entry<1> : public Value
-{
-public:
-    template<typename T>
-    Entry<1>& operator=(T&& value)
+    // Rounds x, the result of a single rounding in a wider type, to out. Fails
+    // when x is next to a midpoint of the narrower type, where rounding twice
+    // may differ from rounding the exact value once.
+    inline bool narrow(double x, double& out)
     {
-        (void)Value::operator=(std::forward<T>(value));
-        return *this;
+        out = x;
+        return true;
     }
-};
 
-template<>
-class Entry<0> : public Value
-{
-public:
-    using iterator = std::map<std::string, Entry<1>>::iterator;
-    using const_iterator = std::map<std::string, Entry<1>>::const_iterator;
-
-    template <typename T>
-    Entry<0>& operator=(T&& value)
+    inline bool narrow(double x, float& out)
     {
-        m_section = false;
-        (void)Value::operator=(std::forward<T>(value));
-        return *this;
+        uint64_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        uint64_t low = bits & 0x1FFFFFFF;
+        if (low >= 0x0FFFFFFF && low <= 0x10000001)
+        {
+            return false;
+        }
+        out = static_cast<float>(x);
+        return true;
     }
 
-    void clear()
+#if LDBL_MANT_DIG == 64 && (defined(__x86_64__) || defined(__i386__)) && !defined(_WIN32)
+    inline bool narrow(long double x, double& out)
     {
-        Value::clear();
-        m_kv.clear();
+        uint64_t mantissa;
+        std::memcpy(&mantissa, &x, sizeof(mantissa));
+        uint64_t low = mantissa & 0x7FF;
+        if (low >= 0x3FF && low <= 0x401)
+        {
+            return false;
+        }
+        out = static_cast<double>(x);
+        return true;
     }
+#define SIMPLEINI_EXTENDED_DOUBLE
+#endif
 
-    bool empty() const
+    template <typename T>
+    bool decode_number(const char*& p, const char* end, T& out, std::integral_constant<int, 2>)
     {
-        return m_section ? m_kv.empty() : Value::empty();
-    }
+        // exact powers of ten, see Clinger's fast path
+        static const double powers[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+        const bool single = std::is_same<T, float>::value;
+        const char* begin = p;
+        bool negative { false };
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p++ == '-';
+        }
+        uint64_t mantissa { 0 };
+        const char* digits = p;
+        size_t n = read_digits(p, end, mantissa);
+        long exponent { 0 };
+        if (p < end && *p == '.')
+        {
+            ++p;
+            size_t fraction = read_digits(p, end, mantissa);
+            exponent -= static_cast<long>(fraction);
+            n += fraction;
+        }
+        if (n == 0)
+        {
+            return false;
+        }
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            ++p;
+            bool negativeExponent { false };
+            if (p < end && (*p == '-' || *p == '+'))
+            {
+                negativeExponent = *p++ == '-';
+            }
+            uint64_t e { 0 };
+            size_t en = read_digits(p, end, e);
+            if (en == 0 || en > 4)
+            {
+                return false;
+            }
+            exponent += negativeExponent ? -static_cast<long>(e) : static_cast<long>(e);
+        }
 
-    size_t count() const
-    {
-        return m_section ? m_kv.size() : 1;
+        while (digits < p && (*digits == '0' || *digits == '.'))
+        {
+            ++digits;
+        }
+        size_t significant = n - std::min<size_t>(n, static_cast<size_t>(std::count_if(begin, digits, is_digit)));
+        if (exponent >= -22 && exponent <= 22)
+        {
+            // mantissa and power are exact, the product or quotient is
+            // rounded once
+            T v {};
+            if (significant <= 15)
+            {
+                double x = static_cast<double>(mantissa);
+                x = exponent < 0 ? x / powers[-exponent] : x * powers[exponent];
+                if (narrow(x, v))
+                {
+                    out = negative ? -v : v;
+                    return true;
+                }
+            }
+#ifdef SIMPLEINI_EXTENDED_DOUBLE
+            else if (significant <= 19 && !single)
+            {
+                long double x = static_cast<long double>(mantissa);
+                long double power = static_cast<long double>(powers[exponent < 0 ? -exponent : exponent]);
+                x = exponent < 0 ? x / power : x * power;
+                double d {};
+                if (narrow(x, d))
+                {
+                    out = static_cast<T>(negative ? -d : d);
+                    return true;
+                }
+            }
+#endif
+        }
+
+        // strtod reads the same grammar as istream in the classic locale
+        if (std::localeconv()->decimal_point[0] != '.')
+        {
+            return false;
+        }
+        char* stop { nullptr };
+        errno = 0;
+        T v = single ? static_cast<T>(std::strtof(begin, &stop)) : static_cast<T>(std::strtod(begin, &stop));
+        if (stop != p || errno != 0)
+        {
+            return false;
+        }
+        out = v;
+        return true;
     }
 
-    bool section() const
+    template <typename T>
+    using array_decoder = std::integral_constant<int,
+            traits::is_bool<T>::value ? 0
+            : traits::is_integral<T>::value ? 1
+            : std::is_same<T, float>::value || std::is_same<T, double>::value ? 2 : 0
+        >;
+
+    template <typename T>
+    bool decode_array(const std::string&, std::vector<T>&, std::integral_constant<int, 0>)
     {
-        return m_section;
+        return false;
     }
 
-    Entry<1>& operator[](const std::string& name)
+    // Decodes a numeric array in a single pass over the raw text, without
+    // splitting it into element strings. Follows the layout of index_array.
+    template <typename T, int Kind>
+    bool decode_array(const std::string& array, std::vector<T>& out, std::integral_constant<int, Kind> kind)
     {
-        m_section = true;
-        if (m_kv.find(name) == m_kv.end())
+        auto b = array.find('[');
+        auto e = array.rfind(']');
+        if (b == std::string::npos || e == std::string::npos || b + 1 >= e)
+        {
+            return true;
+        }
+        out.reserve(static_cast<size_t>(std::count(array.begin() + b, array.begin() + e, ',')) + 1);
+        const char* p = array.data() + b + 1;
+        const char* end = array.data() + array.size();
+        while (p < end)
         {
-            m_kv[name] = Entry<1>{};
+            if (*p == ']')
+            {
+                break;
+            }
+            if (*p == ',')
+            {
+                ++p;
+                continue;
+            }
+            while (p < end && (*p == ' ' || *p == '\t'))
+            {
+                ++p;
+            }
+            T v {};
+            if (!decode_number(p, end, v, kind))
+            {
+                return false;
+            }
+            while (p < end && (*p == ' ' || *p == '\t'))
+            {
+                ++p;
+            }
+            if (p == end || (*p != ',' && *p != ']'))
+            {
+                return false;
+            }
+            out.push_back(v);
         }
-        return m_kv[name];
+        return true;
     }
 
-    iterator begin()
+    template <typename T>
+    std::vector<T> from_raw_array(const std::string& raw)
     {
-        return m_kv.begin();
+        std::vector<T> out;
+        if (decode_array(raw, out, array_decoder<T>{}))
+        {
+            return out;
+        }
+        out.clear();
+        auto vs = utils::splitArray(raw);
+        out.reserve(vs.size());
+        for (auto& v : vs)
+        {
+            out.push_back(from_raw_value<T>(std::move(v)));
+        }
+        return out;
     }
 
-    iterator end()
+    template <typename Iter>
+    class Range
     {
-        return m_kv.end();
-    }
+    public:
+        Range(Iter begin, Iter end)
+            : m_begin{begin}
+            , m_end{end}
+        { }
+
+        Iter begin() const
+        {
+            return m_begin;
+        }
+
+        Iter end() const
+        {
+            return m_end;
+        }
+
+        bool empty() const
+        {
+            return m_begin == m_end;
+        }
+
+    private:
+        Iter m_begin;
+        Iter m_end;
+    };
+
+    template <typename = void>
+    std::string prefix_successor(std::string prefix)
+    {
+        while (!prefix.empty() && static_cast<unsigned char>(prefix.back()) == 0xff)
+        {
+            prefix.pop_back();
+        }
+        if (!prefix.empty())
+        {
+            prefix.back() = static_cast<char>(static_cast<unsigned char>(prefix.back()) + 1);
+        }
+        return prefix;
+    }
+
+    template <typename Map>
+    auto prefix_range(Map& map, const std::string& prefix) -> Range<decltype(map.begin())>
+    {
+        auto next = prefix_successor(prefix);
+        return {map.lower_bound(prefix), next.empty() ? map.end() : map.lower_bound(next)};
+    }
+
+    template <typename = void>
+    bool glob_match(const std::string& pattern, const std::string& text)
+    {
+        size_t p { 0 };
+        size_t t { 0 };
+        size_t star { std::string::npos };
+        size_t mark { 0 };
+        while (t < text.size())
+        {
+            if (p < pattern.size() && pattern[p] == '*')
+            {
+                star = p++;
+                mark = t;
+            }
+            else if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t]))
+            {
+                ++p;
+                ++t;
+            }
+            else if (star != std::string::npos)
+            {
+                p = star + 1;
+                t = ++mark;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        while (p < pattern.size() && pattern[p] == '*')
+        {
+            ++p;
+        }
+        return p == pattern.size();
+    }
+
+    template <typename Map>
+    auto glob_range(Map& map, const std::string& pattern) -> std::vector<decltype(map.begin())>
+    {
+        std::vector<decltype(map.begin())> matches;
+        auto range = prefix_range(map, pattern.substr(0, pattern.find_first_of("*?")));
+        for (auto it = range.begin(); it != range.end(); ++it)
+        {
+            if (glob_match(pattern, it->first))
+            {
+                matches.push_back(it);
+            }
+        }
+        return matches;
+    }
+
+    inline uint64_t hash_bytes(const char* data, size_t size)
+    {
+        uint64_t hash { 14695981039346656037ull };
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    inline uint64_t hash_text(const std::string& text)
+    {
+        return hash_bytes(text.data(), text.size());
+    }
+
+    // Key argument of lookups, which need no std::string under C++17.
+#ifdef SIMPLEINI_STRING_VIEW
+    using KeyView = std::string_view;
+    using KeyLess = std::less<>;
+#else
+    using KeyView = const std::string&;
+    using KeyLess = std::less<std::string>;
+#endif
+
+    inline uint64_t hash_key(KeyView key)
+    {
+        return hash_bytes(key.data(), key.size());
+    }
+
+    // Bytes allocated by text, none while it fits the inline buffer.
+    inline size_t heap_bytes(const std::string& text)
+    {
+        static const size_t inline_capacity { std::string{}.capacity() };
+        return text.capacity() > inline_capacity ? text.capacity() + 1 : 0;
+    }
+
+    // Bytes of a std::map node holding T, the tree links and color included.
+    template <typename T>
+    constexpr size_t node_bytes()
+    {
+        return sizeof(T) + 4 * sizeof(void*);
+    }
+
+    inline uint64_t mix(uint64_t a, uint64_t b)
+    {
+        uint64_t x = a * 0x9e3779b97f4a7c15ull ^ b;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    // Array of numbers kept in native form. The text form is formatted on
+    // first use and kept for the lifetime of the array, which is immutable.
+    class NativeArray
+    {
+    public:
+        virtual ~NativeArray()
+        {
+            delete m_text.load(std::memory_order_relaxed);
+        }
+
+        virtual size_t size() const = 0;
+        virtual size_t bytes() const = 0;
+        virtual uint64_t hash() const = 0;
+
+        const void* type() const
+        {
+            return m_type;
+        }
+
+        const std::string& text() const
+        {
+            auto text = m_text.load(std::memory_order_acquire);
+            if (text == nullptr)
+            {
+                std::unique_ptr<std::string> formatted { new std::string{format()} };
+                if (m_text.compare_exchange_strong(text, formatted.get(), std::memory_order_acq_rel))
+                {
+                    text = formatted.release();
+                }
+            }
+            return *text;
+        }
+
+    protected:
+        explicit NativeArray(const void* type)
+            : m_type{type}
+        { }
+
+        virtual std::string format() const = 0;
+
+        size_t text_bytes() const
+        {
+            auto text = m_text.load(std::memory_order_acquire);
+            return text != nullptr ? sizeof(std::string) + heap_bytes(*text) : 0;
+        }
+
+    private:
+        const void* m_type;
+        mutable std::atomic<std::string*> m_text { nullptr };
+    };
+
+    template <typename T>
+    class TypedArray : public NativeArray
+    {
+    public:
+        explicit TypedArray(std::vector<T> values)
+            : NativeArray{tag()}
+            , m_values{std::move(values)}
+        { }
+
+        static const void* tag()
+        {
+            static const char tag {};
+            return &tag;
+        }
+
+        const std::vector<T>& values() const
+        {
+            return m_values;
+        }
+
+        size_t size() const override
+        {
+            return m_values.size();
+        }
+
+        size_t bytes() const override
+        {
+            return sizeof(*this) + m_values.capacity() * sizeof(T) + text_bytes();
+        }
+
+        // Hash of the element bytes and type, which costs no formatting; it
+        // differs from the hash of the same array stored as text.
+        uint64_t hash() const override
+        {
+            uint64_t type = sizeof(T) * 4 + (std::is_floating_point<T>::value ? 2 : 0) + (std::is_signed<T>::value ? 1 : 0);
+            return mix(hash_bytes(reinterpret_cast<const char*>(m_values.data()), m_values.size() * sizeof(T)), type);
+        }
+
+    protected:
+        std::string format() const override
+        {
+            return to_raw_value<T>(m_values.begin(), m_values.end());
+        }
+
+    private:
+        std::vector<T> m_values;
+    };
+
+    // Minimal perfect hash over a fixed set of 64 bit hashes, built with the
+    // hash and displace method: the hashes are split into buckets of a few
+    // elements, and each bucket gets a displacement moving all its elements
+    // to free positions, largest buckets first. A position costs a modulo, a
+    // table read and a mix; the table takes 4 bytes per bucket.
+    class PerfectHash
+    {
+    public:
+        // Fails when two hashes are equal or no displacement is found.
+        bool build(const std::vector<uint64_t>& hashes)
+        {
+            std::vector<uint64_t> sorted { hashes };
+            std::sort(sorted.begin(), sorted.end());
+            if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end())
+            {
+                return false;
+            }
+            m_size = hashes.size();
+            m_displacements.assign(std::max<size_t>(1, (m_size + 3) / 4), 0);
+            std::vector<std::vector<uint64_t>> buckets(m_displacements.size());
+            for (auto h : hashes)
+            {
+                buckets[h % buckets.size()].push_back(h);
+            }
+            std::vector<size_t> order(buckets.size());
+            for (size_t i = 0; i < order.size(); ++i)
+            {
+                order[i] = i;
+            }
+            std::stable_sort(order.begin(), order.end(), [&buckets](size_t a, size_t b)
+            {
+                return buckets[a].size() > buckets[b].size();
+            });
+
+            std::vector<bool> taken(m_size);
+            std::vector<size_t> positions;
+            for (auto b : order)
+            {
+                const auto& bucket = buckets[b];
+                if (bucket.empty())
+                {
+                    break;
+                }
+                uint32_t d { 0 };
+                for (;; ++d)
+                {
+                    if (d == std::numeric_limits<uint32_t>::max())
+                    {
+                        return false;
+                    }
+                    positions.clear();
+                    bool free { true };
+                    for (size_t i = 0; free && i < bucket.size(); ++i)
+                    {
+                        size_t p = mix(bucket[i], d) % m_size;
+                        free = !taken[p] && std::find(positions.begin(), positions.end(), p) == positions.end();
+                        positions.push_back(p);
+                    }
+                    if (free)
+                    {
+                        break;
+                    }
+                }
+                m_displacements[b] = d;
+                for (auto p : positions)
+                {
+                    taken[p] = true;
+                }
+            }
+            return true;
+        }
+
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        size_t position(uint64_t hash) const
+        {
+            return mix(hash, m_displacements[hash % m_displacements.size()]) % m_size;
+        }
+
+        // Native byte order: an index is meant to be loaded on the host
+        // which wrote it.
+        std::string serialize() const
+        {
+            std::string data { "SIPH" };
+            append(data, static_cast<uint64_t>(m_size));
+            append(data, static_cast<uint64_t>(m_displacements.size()));
+            for (auto d : m_displacements)
+            {
+                append(data, d);
+            }
+            return data;
+        }
+
+        bool deserialize(const std::string& data)
+        {
+            uint64_t size {};
+            uint64_t buckets {};
+            size_t at { 4 };
+            if (data.compare(0, 4, "SIPH") != 0 || !extract(data, at, size) || !extract(data, at, buckets)
+                || buckets == 0 || (data.size() - at) / sizeof(uint32_t) != buckets || (data.size() - at) % sizeof(uint32_t) != 0)
+            {
+                return false;
+            }
+            m_size = static_cast<size_t>(size);
+            m_displacements.resize(static_cast<size_t>(buckets));
+            for (auto& d : m_displacements)
+            {
+                extract(data, at, d);
+            }
+            return true;
+        }
+
+    private:
+        template <typename T>
+        static void append(std::string& data, T value)
+        {
+            data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+
+        template <typename T>
+        static bool extract(const std::string& data, size_t& at, T& value)
+        {
+            if (data.size() - at < sizeof(value))
+            {
+                return false;
+            }
+            std::memcpy(&value, data.data() + at, sizeof(value));
+            at += sizeof(value);
+            return true;
+        }
+
+        size_t m_size { 0 };
+        std::vector<uint32_t> m_displacements;
+    };
+
+    // Sorted map of strings whose copies share all their nodes: an AVL tree
+    // of immutable nodes where an update copies only the path to the key
+    // and the nodes rotated on it, leaving other copies untouched. Elements
+    // are held by pointer, so copied nodes share them as well.
+    template <typename V>
+    class PersistentMap
+    {
+        using Element = std::pair<const std::string, V>;
+        using Shared = std::shared_ptr<const Element>;
+
+        struct Node
+        {
+            Shared element;
+            std::shared_ptr<const Node> left;
+            std::shared_ptr<const Node> right;
+            int height;
+        };
+
+        using Ptr = std::shared_ptr<const Node>;
+
+    public:
+        PersistentMap() = default;
+
+        // Builds a balanced tree from elements sorted by key.
+        explicit PersistentMap(std::vector<std::pair<std::string, V>>&& sorted)
+            : m_root{build(sorted, 0, sorted.size())}
+            , m_size{sorted.size()}
+        { }
+
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        bool empty() const
+        {
+            return m_size == 0;
+        }
+
+        const V* find(KeyView key) const
+        {
+            const Node* node = m_root.get();
+            while (node != nullptr)
+            {
+                int order = key.compare(node->element->first);
+                if (order == 0)
+                {
+                    return &node->element->second;
+                }
+                node = order < 0 ? node->left.get() : node->right.get();
+            }
+            return nullptr;
+        }
+
+        // Calls f(V&) with a copy of the value of key, a default value if
+        // missing, and stores it in place of the old one. Returns whether
+        // key was added.
+        template <typename F>
+        bool update(const std::string& key, F f)
+        {
+            bool added { false };
+            m_root = update(m_root, key, f, added);
+            m_size += added;
+            return added;
+        }
+
+        // Calls f(key, value) for each element in key order.
+        template <typename F>
+        void for_each(F f) const
+        {
+            std::vector<const Node*> stack;
+            const Node* node = m_root.get();
+            while (node != nullptr || !stack.empty())
+            {
+                for (; node != nullptr; node = node->left.get())
+                {
+                    stack.push_back(node);
+                }
+                node = stack.back();
+                stack.pop_back();
+                f(node->element->first, node->element->second);
+                node = node->right.get();
+            }
+        }
+
+    private:
+        static int height(const Ptr& node)
+        {
+            return node ? node->height : 0;
+        }
+
+        static Ptr make(Shared element, Ptr left, Ptr right)
+        {
+            int h = std::max(height(left), height(right)) + 1;
+            return std::make_shared<const Node>(Node{std::move(element), std::move(left), std::move(right), h});
+        }
+
+        static Ptr balance(Shared element, Ptr left, Ptr right)
+        {
+            if (height(left) > height(right) + 1)
+            {
+                if (height(left->left) >= height(left->right))
+                {
+                    return make(left->element, left->left, make(std::move(element), left->right, std::move(right)));
+                }
+                const auto& pivot = left->right;
+                return make(pivot->element, make(left->element, left->left, pivot->left),
+                    make(std::move(element), pivot->right, std::move(right)));
+            }
+            if (height(right) > height(left) + 1)
+            {
+                if (height(right->right) >= height(right->left))
+                {
+                    return make(right->element, make(std::move(element), std::move(left), right->left), right->right);
+                }
+                const auto& pivot = right->left;
+                return make(pivot->element, make(std::move(element), std::move(left), pivot->left),
+                    make(right->element, pivot->right, right->right));
+            }
+            return make(std::move(element), std::move(left), std::move(right));
+        }
+
+        template <typename F>
+        static Ptr update(const Ptr& node, const std::string& key, F& f, bool& added)
+        {
+            if (!node)
+            {
+                added = true;
+                V value {};
+                f(value);
+                return make(std::make_shared<const Element>(key, std::move(value)), nullptr, nullptr);
+            }
+            int order = key.compare(node->element->first);
+            if (order < 0)
+            {
+                return balance(node->element, update(node->left, key, f, added), node->right);
+            }
+            if (order > 0)
+            {
+                return balance(node->element, node->left, update(node->right, key, f, added));
+            }
+            V value { node->element->second };
+            f(value);
+            return make(std::make_shared<const Element>(key, std::move(value)), node->left, node->right);
+        }
+
+        static Ptr build(std::vector<std::pair<std::string, V>>& sorted, size_t b, size_t e)
+        {
+            if (b == e)
+            {
+                return nullptr;
+            }
+            size_t m = b + (e - b) / 2;
+            auto left = build(sorted, b, m);
+            auto right = build(sorted, m + 1, e);
+            auto element = std::make_shared<const Element>(std::move(sorted[m].first), std::move(sorted[m].second));
+            return make(std::move(element), std::move(left), std::move(right));
+        }
+
+        Ptr m_root;
+        size_t m_size { 0 };
+    };
+
+    // Walks two maps sorted by the same key in lockstep, calling visit with
+    // the matching elements of both (nullptr when a key is missing in one).
+    template <typename A, typename B, typename F>
+    void merge_walk(const A& a, const B& b, F visit)
+    {
+        auto ia = a.begin();
+        auto ib = b.begin();
+        while (ia != a.end() || ib != b.end())
+        {
+            int order = ia == a.end() ? 1 : ib == b.end() ? -1 : ia->first.compare(ib->first);
+            if (order < 0)
+            {
+                visit(&*ia++, nullptr);
+            }
+            else if (order > 0)
+            {
+                visit(nullptr, &*ib++);
+            }
+            else
+            {
+                visit(&*ia++, &*ib++);
+            }
+        }
+    }
+
+    // Receives changes of the fingerprints of child entries.
+    class Parent
+    {
+    public:
+        virtual void updated(uint64_t before, uint64_t after) = 0;
+
+        // Receives the name hash of a child entry that was assigned a value.
+        virtual void assigned(uint64_t) { }
+
+        // Receives the change of the number of keys of a child entry, also
+        // called with 0 when a section becomes a plain key or back.
+        virtual void resized(long) { }
+
+    protected:
+        ~Parent() = default;
+    };
+
+#ifdef SIMPLEINI_ACCESS_TRACKING
+    class Counter
+    {
+    public:
+        Counter() = default;
+
+        Counter(const Counter& other)
+            : m_value{other.load()}
+        { }
+
+        Counter& operator=(const Counter& other)
+        {
+            m_value.store(other.load(), std::memory_order_relaxed);
+            return *this;
+        }
+
+        void increment() const
+        {
+            m_value.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        size_t load() const
+        {
+            return m_value.load(std::memory_order_relaxed);
+        }
+
+        void reset() const
+        {
+            m_value.store(0, std::memory_order_relaxed);
+        }
+
+    private:
+        mutable std::atomic<size_t> m_value { 0 };
+    };
+#endif
+}
+
+struct MemoryUsage
+{
+    size_t keys { 0 };      // key and section names
+    size_t values { 0 };    // raw values, unused capacity included
+    size_t overhead { 0 };  // map nodes and entries
+
+    size_t total() const
+    {
+        return keys + values + overhead;
+    }
+
+    MemoryUsage& operator+=(const MemoryUsage& other)
+    {
+        keys += other.keys;
+        values += other.values;
+        overhead += other.overhead;
+        return *this;
+    }
+};
+
+class Value
+{
+public:
+    Value() = default;
+
+    Value(const Value& other)
+        : m_raw{other.m_raw}
+        , m_native{other.m_native}
+#ifdef SIMPLEINI_ACCESS_TRACKING
+        , m_reads{other.m_reads}
+#endif
+        , m_key{other.m_key}
+        , m_fingerprint{other.m_fingerprint}
+    { }
+
+    Value(Value&& other)
+        : m_raw{std::move(other.m_raw)}
+        , m_native{std::move(other.m_native)}
+#ifdef SIMPLEINI_ACCESS_TRACKING
+        , m_reads{other.m_reads}
+#endif
+        , m_key{other.m_key}
+        , m_fingerprint{other.m_fingerprint}
+        , m_index{other.m_index.exchange(nullptr)}
+        , m_decoded{other.m_decoded.exchange(nullptr)}
+    { }
+
+    virtual ~Value()
+    {
+        delete m_index.load(std::memory_order_relaxed);
+        delete m_decoded.load(std::memory_order_relaxed);
+    }
+
+    Value& operator=(const Value& other)
+    {
+        m_raw = other.m_raw;
+        m_native = other.m_native;
+        changed();
+        return *this;
+    }
+
+    Value& operator=(Value&& other)
+    {
+        m_raw = std::move(other.m_raw);
+        m_native = std::move(other.m_native);
+        changed();
+        return *this;
+    }
+
+    template <typename T, typename = traits::disable_value<T>>
+    Value& operator=(T&& v)
+    {
+        assign(std::forward<T>(v), traits::is_native_array<typename traits::remove_cvref<T>::type>{});
+        changed();
+        return *this;
+    }
+
+    template<typename T>
+    T value(const T& defaultValue = T{}) const
+    {
+        track();
+        const auto& raw = this->raw();
+        return raw.empty() ? defaultValue : utils::from_raw_value<T>(raw);
+    }
+
+    template <typename T>
+    std::vector<T> array() const
+    {
+        track();
+        if (auto values = native<T>())
+        {
+            return *values;
+        }
+        return utils::from_raw_array<T>(raw());
+    }
+
+    // Elements of a large array of numbers assigned as std::vector<T>, see
+    // SIMPLEINI_NATIVE_ARRAY_SIZE; nullptr if the value is kept as text.
+    template <typename T>
+    const std::vector<T>* native() const
+    {
+        if (!m_native || m_native->type() != utils::TypedArray<T>::tag())
+        {
+            return nullptr;
+        }
+        return &static_cast<const utils::TypedArray<T>*>(m_native.get())->values();
+    }
+
+    // Number of elements of an array value, see array_at().
+    size_t array_size() const
+    {
+        track();
+        return m_native ? m_native->size() : index().size();
+    }
+
+    // Decodes only element i of an array value. The element offsets are
+    // indexed on first access and reused until the value changes.
+    template <typename T>
+    T array_at(size_t i, const T& defaultValue = T{}) const
+    {
+        track();
+        if (auto values = native<T>())
+        {
+            return i < values->size() ? (*values)[i] : defaultValue;
+        }
+        const auto& raw = this->raw();
+        const auto& items = index();
+        if (i >= items.size())
+        {
+            return defaultValue;
+        }
+        return utils::from_raw_value<T>(raw.substr(items[i].first, items[i].second - items[i].first));
+    }
+
+    template<typename T>
+    T take(const T& defaultValue = T{})
+    {
+        track();
+        std::string raw { m_native ? m_native->text() : std::move(m_raw) };
+        m_raw.clear();
+        m_native.reset();
+        changed();
+        return raw.empty() ? defaultValue : utils::from_raw_value<T>(std::move(raw));
+    }
+
+    void clear()
+    {
+        m_raw.clear();
+        m_native.reset();
+        changed();
+    }
+
+    bool empty() const
+    {
+        return !m_native && m_raw.empty();
+    }
+
+    const std::string& raw() const
+    {
+        return m_native ? m_native->text() : m_raw;
+    }
+
+    uint64_t fingerprint() const
+    {
+        return m_parent != nullptr ? m_fingerprint : utils::mix(m_key, content());
+    }
+
+#ifdef SIMPLEINI_ACCESS_TRACKING
+    size_t reads() const
+    {
+        return m_reads.load();
+    }
+
+    void reset_reads() const
+    {
+        m_reads.reset();
+    }
+#endif
+
+protected:
+    virtual uint64_t content() const
+    {
+        return m_native ? m_native->hash() : utils::hash_text(m_raw);
+    }
+
+    void attach(utils::Parent* parent, const std::string& name)
+    {
+        m_parent = parent;
+        m_key = utils::hash_text(name);
+        m_fingerprint = utils::mix(m_key, content());
+        m_parent->updated(0, m_fingerprint);
+    }
+
+    void adopt(utils::Parent* parent)
+    {
+        m_parent = parent;
+    }
+
+    void changed()
+    {
+        refresh();
+        if (m_parent != nullptr)
+        {
+            m_parent->assigned(m_key);
+        }
+    }
+
+    void refresh()
+    {
+        delete m_index.exchange(nullptr, std::memory_order_acq_rel);
+        delete m_decoded.exchange(nullptr, std::memory_order_acq_rel);
+        if (m_parent == nullptr)
+        {
+            return;
+        }
+        uint64_t before = m_fingerprint;
+        m_fingerprint = utils::mix(m_key, content());
+        m_parent->updated(before, m_fingerprint);
+    }
+
+    void propagate(uint64_t key)
+    {
+        if (m_parent != nullptr)
+        {
+            m_parent->assigned(utils::mix(m_key, key));
+        }
+    }
+
+    void recount(long delta)
+    {
+        if (m_parent != nullptr)
+        {
+            m_parent->resized(delta);
+        }
+    }
+
+    // Heap bytes of the value; native arrays shared by copies are counted
+    // by each of them.
+    size_t value_bytes() const
+    {
+        size_t bytes = utils::heap_bytes(m_raw);
+        if (m_native)
+        {
+            bytes += m_native->bytes();
+        }
+        if (auto index = m_index.load(std::memory_order_acquire))
+        {
+            bytes += sizeof(*index) + index->capacity() * sizeof(index->front());
+        }
+        if (auto decoded = m_decoded.load(std::memory_order_acquire))
+        {
+            bytes += sizeof(*decoded) + utils::heap_bytes(*decoded);
+        }
+        return bytes;
+    }
+
+    void shrink()
+    {
+        m_raw.shrink_to_fit();
+    }
+
+private:
+    template <typename, typename>
+    friend class ConfigImpl;
+
+    void track() const
+    {
+#ifdef SIMPLEINI_ACCESS_TRACKING
+        m_reads.increment();
+#endif
+    }
+
+    // Concurrent readers may both build the index, one of them is dropped.
+    const utils::ArrayIndex& index() const
+    {
+        auto index = m_index.load(std::memory_order_acquire);
+        if (index == nullptr)
+        {
+            std::unique_ptr<utils::ArrayIndex> built { new utils::ArrayIndex{utils::index_array(raw())} };
+            if (m_index.compare_exchange_strong(index, built.get(), std::memory_order_acq_rel))
+            {
+                index = built.release();
+            }
+        }
+        return *index;
+    }
+
+    // Text with escapes decoded once for views into it, see index().
+    const std::string& decoded() const
+    {
+        auto decoded = m_decoded.load(std::memory_order_acquire);
+        if (decoded == nullptr)
+        {
+            std::unique_ptr<std::string> built { new std::string{utils::decode_text(raw())} };
+            if (m_decoded.compare_exchange_strong(decoded, built.get(), std::memory_order_acq_rel))
+            {
+                decoded = built.release();
+            }
+        }
+        return *decoded;
+    }
+
+    template <typename T>
+    void assign(T&& v, std::false_type)
+    {
+        m_raw = utils::to_raw_value(std::forward<T>(v));
+        m_native.reset();
+    }
+
+    template <typename T>
+    void assign(T&& v, std::true_type)
+    {
+        using E = typename traits::remove_cvref<T>::type::value_type;
+        if (v.size() < SIMPLEINI_NATIVE_ARRAY_SIZE)
+        {
+            assign(std::forward<T>(v), std::false_type{});
+            return;
+        }
+        m_native = std::make_shared<utils::TypedArray<E>>(std::forward<T>(v));
+        m_raw.clear();
+    }
+
+    std::string m_raw;
+    std::shared_ptr<const utils::NativeArray> m_native;
+#ifdef SIMPLEINI_ACCESS_TRACKING
+    utils::Counter m_reads;
+#endif
+    utils::Parent* m_parent { nullptr };
+    uint64_t m_key { 0 };
+    uint64_t m_fingerprint { 0 };
+    mutable std::atomic<utils::ArrayIndex*> m_index { nullptr };
+    mutable std::atomic<std::string*> m_decoded { nullptr };
+};
+
+#ifdef SIMPLEINI_STRING_VIEW
+// A view of the text of a string value, valid until the value is assigned or
+// destroyed. It points into the raw value unless it has escapes, which are
+// decoded once.
+template <>
+inline std::string_view Value::value<std::string_view>(const std::string_view& defaultValue) const
+{
+    track();
+    const auto& raw = this->raw();
+    if (raw.empty())
+    {
+        return defaultValue;
+    }
+    if (raw.find('\\') != std::string::npos)
+    {
+        return decoded();
+    }
+    size_t b = raw.front() == '\"' ? 1 : 0;
+    size_t e = raw.size() > b && raw.back() == '\"' ? raw.size() - 1 : raw.size();
+    return std::string_view{raw}.substr(b, e - b);
+}
+#endif
+
+template<uint T>
+class Entry
+{
+};
+
+
+template<>
+class Entry<1> : public Value
+{
+public:
+    template <uint>
+    friend class Entry;
+
+    template <typename T, typename = traits::disable_value<T>>
+    Entry<1>& operator=(T&& value)
+    {
+        (void)Value::operator=(std::forward<T>(value));
+        return *this;
+    }
+
+    Entry<1>& operator=(const Value& value)
+    {
+        (void)Value::operator=(value);
+        return *this;
+    }
+
+    Entry<1>& operator=(Value&& value)
+    {
+        (void)Value::operator=(std::move(value));
+        return *this;
+    }
+};
+
+template<>
+class Entry<0> : public Value, private utils::Parent
+{
+public:
+    using Keys = std::map<std::string, Entry<1>, utils::KeyLess>;
+    using iterator = Keys::iterator;
+    using const_iterator = Keys::const_iterator;
+
+    Entry() = default;
+
+    Entry(const Entry& other)
+        : Value{other}
+        , m_section{other.m_section}
+        , m_kv{other.m_kv}
+        , m_sum{other.m_sum}
+    {
+        adoptAll();
+    }
+
+    Entry(Entry&& other)
+        : Value{std::move(other)}
+        , m_section{other.m_section}
+        , m_kv{std::move(other.m_kv)}
+        , m_sum{other.m_sum}
+    {
+        adoptAll();
+    }
+
+    Entry& operator=(const Entry& other)
+    {
+        if (this != &other)
+        {
+            size_t before = count();
+            m_kv = other.m_kv;
+            m_section = other.m_section;
+            m_sum = other.m_sum;
+            adoptAll();
+            (void)Value::operator=(static_cast<const Value&>(other));
+            replaced(before);
+        }
+        return *this;
+    }
+
+    Entry& operator=(Entry&& other)
+    {
+        if (this != &other)
+        {
+            size_t before = count();
+            m_kv = std::move(other.m_kv);
+            m_section = other.m_section;
+            m_sum = other.m_sum;
+            adoptAll();
+            (void)Value::operator=(static_cast<Value&&>(other));
+            replaced(before);
+        }
+        return *this;
+    }
+
+    template <typename T, typename = traits::disable_value<T>>
+    Entry<0>& operator=(T&& value)
+    {
+        return assign(std::forward<T>(value));
+    }
+
+    // Makes the entry a key with the value of a key.
+    Entry<0>& operator=(const Value& value)
+    {
+        return assign(value);
+    }
+
+    Entry<0>& operator=(Value&& value)
+    {
+        return assign(std::move(value));
+    }
+
+    void clear()
+    {
+        size_t before = count();
+        m_kv.clear();
+        m_sum = 0;
+        Value::clear();
+        replaced(before);
+    }
+
+    bool empty() const
+    {
+        return m_section ? m_kv.empty() : Value::empty();
+    }
+
+    size_t count() const
+    {
+        return m_section ? m_kv.size() : 1;
+    }
+
+    bool section() const
+    {
+        return m_section;
+    }
+
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage usage;
+        usage.values = value_bytes();
+        for (const auto& kv : m_kv)
+        {
+            usage.keys += utils::heap_bytes(kv.first);
+            usage.values += kv.second.value_bytes();
+            usage.overhead += utils::node_bytes<std::pair<const std::string, Entry<1>>>();
+        }
+        return usage;
+    }
+
+    Entry<1>& operator[](const std::string& name)
+    {
+        return insert(name);
+    }
+
+    Entry<1>& operator[](std::string&& name)
+    {
+        return insert(std::move(name));
+    }
+
+    iterator find(utils::KeyView name)
+    {
+        return m_kv.find(name);
+    }
+
+    const_iterator find(utils::KeyView name) const
+    {
+        return m_kv.find(name);
+    }
+
+    utils::Range<iterator> prefix(const std::string& prefix)
+    {
+        return utils::prefix_range(m_kv, prefix);
+    }
+
+    utils::Range<const_iterator> prefix(const std::string& prefix) const
+    {
+        return utils::prefix_range(m_kv, prefix);
+    }
+
+    std::vector<iterator> glob(const std::string& pattern)
+    {
+        return utils::glob_range(m_kv, pattern);
+    }
+
+    std::vector<const_iterator> glob(const std::string& pattern) const
+    {
+        return utils::glob_range(m_kv, pattern);
+    }
+
+    iterator begin()
+    {
+        return m_kv.begin();
+    }
+
+    iterator end()
+    {
+        return m_kv.end();
+    }
+
+    const_iterator begin() const
+    {
+        return m_kv.cbegin();
+    }
+
+    const_iterator end() const
+    {
+        return m_kv.cend();
+    }
+
+protected:
+    uint64_t content() const override
+    {
+        return m_section ? utils::mix(m_sum, 1) : Value::content();
+    }
+
+private:
+    template <typename, typename>
+    friend class ConfigImpl;
+
+    template <typename T>
+    Entry<0>& assign(T&& value)
+    {
+        size_t before = count();
+        bool section = m_section;
+        m_section = false;
+        (void)Value::operator=(std::forward<T>(value));
+        counted(before, section);
+        return *this;
+    }
+
+    template <typename K>
+    Entry<1>& insert(K&& name)
+    {
+        if (!m_section)
+        {
+            size_t before = count();
+            m_section = true;
+            changed();
+            counted(before, false);
+        }
+        auto it = m_kv.lower_bound(name);
+        if (it == m_kv.end() || it->first != name)
+        {
+            it = m_kv.emplace_hint(it, std::forward<K>(name), Entry<1>{});
+            it->second.attach(this, it->first);
+            recount(1);
+        }
+        return it->second;
+    }
+
+    void counted(size_t before, bool section)
+    {
+        long delta = static_cast<long>(count()) - static_cast<long>(before);
+        if (delta != 0 || section != m_section)
+        {
+            recount(delta);
+        }
+    }
+
+    // The keys were replaced or removed, so pointers to them are stale even
+    // when their count is unchanged.
+    void replaced(size_t before)
+    {
+        recount(static_cast<long>(count()) - static_cast<long>(before));
+    }
+
+    // Rebuilds the keys in order, so that their nodes and values are
+    // allocated next to each other, with no spare capacity.
+    void compact()
+    {
+        shrink();
+        Keys kv;
+        for (auto& e : m_kv)
+        {
+            auto it = kv.emplace_hint(kv.end(), std::string{e.first}, std::move(e.second));
+            it->second.shrink();
+        }
+        m_kv = std::move(kv);
+        adoptAll();
+    }
+
+    void adoptAll()
+    {
+        for (auto& kv : m_kv)
+        {
+            kv.second.adopt(this);
+        }
+    }
+
+    void updated(uint64_t before, uint64_t after) override
+    {
+        m_sum += after - before;
+        refresh();
+    }
+
+    void assigned(uint64_t key) override
+    {
+        propagate(key);
+    }
+
+    bool m_section { false };
+    Keys m_kv;
+    uint64_t m_sum { 0 };
+};
+
+class Handle
+{
+public:
+    Handle() = default;
+
+    template<typename T>
+    T value(const T& defaultValue = T{}) const
+    {
+        return bound() ? m_slot->value->value<T>(defaultValue) : defaultValue;
+    }
+
+    template <typename T>
+    std::vector<T> array() const
+    {
+        return bound() ? m_slot->value->array<T>() : std::vector<T>{};
+    }
+
+    size_t array_size() const
+    {
+        return bound() ? m_slot->value->array_size() : 0;
+    }
+
+    template <typename T>
+    T array_at(size_t i, const T& defaultValue = T{}) const
+    {
+        return bound() ? m_slot->value->array_at<T>(i, defaultValue) : defaultValue;
+    }
+
+    bool empty() const
+    {
+        return bound() ? m_slot->value->empty() : true;
+    }
+
+    bool valid() const
+    {
+        return static_cast<bool>(m_slot);
+    }
+
+private:
+    template <typename, typename>
+    friend class ConfigImpl;
+
+    // value is nullptr while the key is missing and after the config is
+    // destroyed.
+    struct Slot
+    {
+        std::string section;
+        std::string key;
+        const Value* value;
+    };
+
+    explicit Handle(std::shared_ptr<Slot> slot)
+        : m_slot{std::move(slot)}
+    { }
+
+    bool bound() const
+    {
+        return m_slot && m_slot->value != nullptr;
+    }
+
+    std::shared_ptr<Slot> m_slot;
+};
+
+#ifdef SIMPLEINI_ACCESS_TRACKING
+struct AccessStat
+{
+    std::string section;
+    std::string key;
+    size_t reads;
+};
+#endif
+
+enum ChangeType
+{
+    Change_Added,
+    Change_Removed,
+    Change_Modified
+};
+
+struct Change
+{
+    ChangeType type;
+    std::string section;
+    std::string key;
+};
+
+enum SaveFlags
+{
+    SaveFlag_Default = 0,
+    SaveFlag_SkipEmptyKeys = 0x01,
+    // Formats sections on one thread per hardware thread while the calling
+    // thread writes them in order. The output is the same as without it.
+    SaveFlag_Parallel = 0x02
+};
+
+inline SaveFlags operator|(SaveFlags a, SaveFlags b)
+{
+    return static_cast<SaveFlags>(static_cast<int>(a) | static_cast<int>(b));
+}
+
+enum LoadFlags
+{
+    LoadFlag_Default = 0,
+    // Follows @include lines; off by default, so loading untrusted input
+    // never reads other files.
+    LoadFlag_Includes = 0x01
+};
+
+inline LoadFlags operator|(LoadFlags a, LoadFlags b)
+{
+    return static_cast<LoadFlags>(static_cast<int>(a) | static_cast<int>(b));
+}
+
+namespace utils
+{
+    constexpr size_t CodecBlockSize = 64 * 1024;
+
+    inline bool ends_with(const std::string& text, const std::string& suffix)
+    {
+        return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // Formats text as a Writer does, into memory.
+    struct TextBuffer
+    {
+        std::string text;
+
+        TextBuffer& operator<<(const std::string& s)
+        {
+            text += s;
+            return *this;
+        }
+
+        TextBuffer& operator<<(const char* s)
+        {
+            text += s;
+            return *this;
+        }
+
+        TextBuffer& operator<<(char c)
+        {
+            text += c;
+            return *this;
+        }
+    };
+
+    // Modification time in nanoseconds, as precise as the platform reports.
+    inline long long modified(const struct stat& info)
+    {
+#if defined(__APPLE__)
+        return info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+        return info.st_mtime * 1000000000LL;
+#else
+        return info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#endif
+    }
+
+    // A file is identified by its modification time and size. A file
+    // modified in the second before it was stamped may be modified again
+    // within the resolution of the file system clock without either changing,
+    // so such stamps are never current.
+    struct FileStamp
+    {
+        std::string path;
+        long long mtime;
+        long long size;
+        bool recent;
+
+        bool current() const
+        {
+            struct stat info;
+            return !recent && stat(path.c_str(), &info) == 0
+                && modified(info) == mtime
+                && static_cast<long long>(info.st_size) == size;
+        }
+    };
+
+    template <typename = void>
+    FileStamp stamp(const std::string& path)
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+        {
+            return {path, -1, -1, false};
+        }
+        auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        bool recent = modified(info) > static_cast<long long>(now) - 1000000000LL;
+        return {path, modified(info), static_cast<long long>(info.st_size), recent};
+    }
+
+    template <typename = void>
+    std::string absolute_path(const std::string& path)
+    {
+#if defined(_WIN32)
+        char buffer[_MAX_PATH];
+        if (_fullpath(buffer, path.c_str(), _MAX_PATH) == nullptr)
+        {
+            return {};
+        }
+        return buffer;
+#else
+        char* resolved = realpath(path.c_str(), nullptr);
+        if (resolved == nullptr)
+        {
+            return {};
+        }
+        std::string absolute { resolved };
+        std::free(resolved);
+        return absolute;
+#endif
+    }
+
+    inline std::string directory_of(const std::string& path)
+    {
+        auto pos = path.find_last_of("/\\");
+        return pos == std::string::npos ? std::string{} : path.substr(0, pos + 1);
+    }
+
+    inline bool is_absolute(const std::string& path)
+    {
+        return (!path.empty() && (path[0] == '/' || path[0] == '\\')) || (path.size() > 1 && path[1] == ':');
+    }
+
+#if !defined(_WIN32)
+    // Regular files and symlinks to them; d_type saves the stat where the
+    // file system fills it in.
+    inline bool regular_file(const std::string& path, const dirent* entry)
+    {
+#ifdef DT_REG
+        if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_LNK)
+        {
+            return entry->d_type == DT_REG;
+        }
+#endif
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+    }
+#endif
+
+    template <typename = void>
+    std::vector<std::string> list_directory(const std::string& directory, const std::string& pattern)
+    {
+        std::vector<std::string> names;
+#if defined(_WIN32)
+        _finddata_t data;
+        intptr_t handle = _findfirst((directory + "/*").c_str(), &data);
+        if (handle != -1)
+        {
+            do
+            {
+                if (!(data.attrib & _A_SUBDIR) && glob_match(pattern, data.name))
+                {
+                    names.push_back(data.name);
+                }
+            } while (_findnext(handle, &data) == 0);
+            _findclose(handle);
+        }
+#else
+        DIR* dir = opendir(directory.c_str());
+        if (dir != nullptr)
+        {
+            while (dirent* entry = readdir(dir))
+            {
+                std::string name { entry->d_name };
+                if (glob_match(pattern, name) && regular_file(directory + "/" + name, entry))
+                {
+                    names.push_back(std::move(name));
+                }
+            }
+            closedir(dir);
+        }
+#endif
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    class Input
+    {
+    public:
+        explicit Input(std::FILE* file)
+            : m_file{file}
+        { }
+
+        Input(const Input&) = delete;
+        Input& operator=(const Input&) = delete;
+
+        virtual ~Input()
+        {
+            std::fclose(m_file);
+        }
+
+        virtual size_t read(char* data, size_t size)
+        {
+            return std::fread(data, 1, size, m_file);
+        }
+
+    protected:
+        std::FILE* m_file;
+    };
+
+#ifdef SIMPLEINI_WITH_ZLIB
+    class GzipInput : public Input
+    {
+    public:
+        explicit GzipInput(std::FILE* file)
+            : Input{file}
+            , m_buffer(CodecBlockSize)
+        {
+            m_ok = inflateInit2(&m_stream, 15 + 32) == Z_OK;
+        }
+
+        ~GzipInput() override
+        {
+            inflateEnd(&m_stream);
+        }
+
+        size_t read(char* data, size_t size) override
+        {
+            m_stream.next_out = reinterpret_cast<Bytef*>(data);
+            m_stream.avail_out = static_cast<uInt>(size);
+            while (m_ok && m_stream.avail_out > 0)
+            {
+                if (m_stream.avail_in == 0)
+                {
+                    size_t read = Input::read(m_buffer.data(), m_buffer.size());
+                    if (read == 0)
+                    {
+                        break;
+                    }
+                    m_stream.next_in = reinterpret_cast<Bytef*>(m_buffer.data());
+                    m_stream.avail_in = static_cast<uInt>(read);
+                }
+                int result = inflate(&m_stream, Z_NO_FLUSH);
+                if (result == Z_STREAM_END)
+                {
+                    m_ok = inflateReset(&m_stream) == Z_OK;
+                }
+                else if (result != Z_OK)
+                {
+                    m_ok = false;
+                }
+            }
+            return size - m_stream.avail_out;
+        }
+
+    private:
+        z_stream m_stream {};
+        std::vector<char> m_buffer;
+        bool m_ok { false };
+    };
+#endif
+
+#ifdef SIMPLEINI_WITH_ZSTD
+    class ZstdInput : public Input
+    {
+    public:
+        explicit ZstdInput(std::FILE* file)
+            : Input{file}
+            , m_stream{ZSTD_createDStream()}
+            , m_buffer(ZSTD_DStreamInSize())
+        {
+            m_ok = m_stream != nullptr && !ZSTD_isError(ZSTD_initDStream(m_stream));
+        }
+
+        ~ZstdInput() override
+        {
+            ZSTD_freeDStream(m_stream);
+        }
+
+        size_t read(char* data, size_t size) override
+        {
+            ZSTD_outBuffer output { data, size, 0 };
+            while (m_ok && output.pos < output.size)
+            {
+                if (m_input.pos == m_input.size)
+                {
+                    size_t read = Input::read(m_buffer.data(), m_buffer.size());
+                    if (read == 0)
+                    {
+                        break;
+                    }
+                    m_input = { m_buffer.data(), read, 0 };
+                }
+                m_ok = !ZSTD_isError(ZSTD_decompressStream(m_stream, &output, &m_input));
+            }
+            return output.pos;
+        }
+
+    private:
+        ZSTD_DStream* m_stream;
+        std::vector<char> m_buffer;
+        ZSTD_inBuffer m_input { nullptr, 0, 0 };
+        bool m_ok { false };
+    };
+#endif
+
+    template <typename = void>
+    std::unique_ptr<Input> open_input(const std::string& name)
+    {
+#if defined(SIMPLEINI_WITH_ZLIB) || defined(SIMPLEINI_WITH_ZSTD)
+        {
+            std::FILE* file = std::fopen(name.c_str(), "rb");
+            if (file == nullptr)
+            {
+                return nullptr;
+            }
+            unsigned char magic[4] {};
+            size_t size = std::fread(magic, 1, sizeof(magic), file);
+            std::rewind(file);
+#ifdef SIMPLEINI_WITH_ZLIB
+            if (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+            {
+                return std::unique_ptr<Input>{new GzipInput{file}};
+            }
+#endif
+#ifdef SIMPLEINI_WITH_ZSTD
+            if (size >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+            {
+                return std::unique_ptr<Input>{new ZstdInput{file}};
+            }
+#endif
+            std::fclose(file);
+        }
+#endif
+        std::FILE* file = std::fopen(name.c_str(), "r");
+        if (file == nullptr)
+        {
+            return nullptr;
+        }
+#if defined(__linux__)
+        (void)posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        return std::unique_ptr<Input>{new Input{file}};
+    }
+
+    class OutputBuffer : public std::streambuf
+    {
+    public:
+        explicit OutputBuffer(std::FILE* file)
+            : m_file{file}
+            , m_buffer(CodecBlockSize)
+        {
+            setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+        }
+
+        OutputBuffer(const OutputBuffer&) = delete;
+        OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+        ~OutputBuffer() override
+        {
+            close();
+        }
+
+        // Writes the rest of the output and closes the file, false if any
+        // write failed. Subclasses call it from their destructor too, while
+        // their encoder is alive.
+        bool close()
+        {
+            if (m_file != nullptr)
+            {
+                drain(true);
+                m_failed = std::fflush(m_file) != 0 || m_failed;
+                m_failed = std::fclose(m_file) != 0 || m_failed;
+                m_file = nullptr;
+            }
+            return !m_failed;
+        }
+
+    protected:
+        int_type overflow(int_type c) override
+        {
+            if (!drain(false))
+            {
+                return traits_type::eof();
+            }
+            if (!traits_type::eq_int_type(c, traits_type::eof()))
+            {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        int sync() override
+        {
+            return m_file != nullptr && drain(false) && std::fflush(m_file) == 0 ? 0 : -1;
+        }
+
+        // Writes the buffered text, subclasses compress it on the way.
+        virtual bool write(const char* data, size_t size, bool finish)
+        {
+            (void)finish;
+            return std::fwrite(data, 1, size, m_file) == size;
+        }
+
+        bool drain(bool finish)
+        {
+            m_failed = !write(pbase(), pptr() - pbase(), finish) || m_failed;
+            setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+            return !m_failed;
+        }
+
+        std::FILE* m_file;
+
+    private:
+        std::vector<char> m_buffer;
+        bool m_failed { false };
+    };
+
+#ifdef SIMPLEINI_WITH_ZLIB
+    class GzipOutputBuffer : public OutputBuffer
+    {
+    public:
+        explicit GzipOutputBuffer(std::FILE* file)
+            : OutputBuffer{file}
+            , m_output(CodecBlockSize)
+        {
+            deflateInit2(&m_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+        }
+
+        ~GzipOutputBuffer() override
+        {
+            close();
+            deflateEnd(&m_stream);
+        }
+
+    protected:
+        bool write(const char* data, size_t size, bool finish) override
+        {
+            m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+            m_stream.avail_in = static_cast<uInt>(size);
+            int result { Z_OK };
+            do
+            {
+                m_stream.next_out = reinterpret_cast<Bytef*>(m_output.data());
+                m_stream.avail_out = static_cast<uInt>(m_output.size());
+                result = deflate(&m_stream, finish ? Z_FINISH : Z_NO_FLUSH);
+                if (result == Z_STREAM_ERROR
+                    || !OutputBuffer::write(m_output.data(), m_output.size() - m_stream.avail_out, finish))
+                {
+                    return false;
+                }
+            } while (m_stream.avail_out == 0);
+            return !finish || result == Z_STREAM_END;
+        }
+
+    private:
+        z_stream m_stream {};
+        std::vector<char> m_output;
+    };
+#endif
+
+#ifdef SIMPLEINI_WITH_ZSTD
+    class ZstdOutputBuffer : public OutputBuffer
+    {
+    public:
+        explicit ZstdOutputBuffer(std::FILE* file)
+            : OutputBuffer{file}
+            , m_stream{ZSTD_createCStream()}
+            , m_output(ZSTD_CStreamOutSize())
+        {
+            ZSTD_initCStream(m_stream, 3);
+        }
+
+        ~ZstdOutputBuffer() override
+        {
+            close();
+            ZSTD_freeCStream(m_stream);
+        }
+
+    protected:
+        bool write(const char* data, size_t size, bool finish) override
+        {
+            ZSTD_inBuffer input { data, size, 0 };
+            size_t pending { 0 };
+            do
+            {
+                ZSTD_outBuffer output { m_output.data(), m_output.size(), 0 };
+                if (input.pos < input.size)
+                {
+                    pending = ZSTD_compressStream(m_stream, &output, &input);
+                }
+                else
+                {
+                    pending = finish ? ZSTD_endStream(m_stream, &output) : 0;
+                }
+                if (ZSTD_isError(pending) || !OutputBuffer::write(m_output.data(), output.pos, finish))
+                {
+                    return false;
+                }
+            } while (input.pos < input.size || pending > 0);
+            return true;
+        }
+
+    private:
+        ZSTD_CStream* m_stream;
+        std::vector<char> m_output;
+    };
+#endif
+
+    template <typename = void>
+    std::unique_ptr<OutputBuffer> open_output(const std::string& name)
+    {
+        bool compressed { false };
+#ifdef SIMPLEINI_WITH_ZLIB
+        compressed = compressed || ends_with(name, ".gz");
+#endif
+#ifdef SIMPLEINI_WITH_ZSTD
+        compressed = compressed || ends_with(name, ".zst");
+#endif
+        std::FILE* file = std::fopen(name.c_str(), compressed ? "wb" : "w");
+        if (file == nullptr)
+        {
+            return nullptr;
+        }
+#ifdef SIMPLEINI_WITH_ZLIB
+        if (ends_with(name, ".gz"))
+        {
+            return std::unique_ptr<OutputBuffer>{new GzipOutputBuffer{file}};
+        }
+#endif
+#ifdef SIMPLEINI_WITH_ZSTD
+        if (ends_with(name, ".zst"))
+        {
+            return std::unique_ptr<OutputBuffer>{new ZstdOutputBuffer{file}};
+        }
+#endif
+        return std::unique_ptr<OutputBuffer>{new OutputBuffer{file}};
+    }
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+    using SharedMutex = std::shared_mutex;
+#elif __cplusplus >= 201402L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+    using SharedMutex = std::shared_timed_mutex;
+#else
+    // Reader-writer lock for C++11, which has none: threads wait on condition
+    // variables, and a waiting writer stops new readers from entering.
+    class SharedMutex
+    {
+    public:
+        void lock_shared()
+        {
+            std::unique_lock<std::mutex> lock { m_mutex };
+            m_readable.wait(lock, [this]() { return !m_writer && m_waiting == 0; });
+            ++m_readers;
+        }
+
+        void unlock_shared()
+        {
+            std::lock_guard<std::mutex> lock { m_mutex };
+            if (--m_readers == 0 && m_waiting != 0)
+            {
+                m_writable.notify_one();
+            }
+        }
+
+        void lock()
+        {
+            std::unique_lock<std::mutex> lock { m_mutex };
+            ++m_waiting;
+            m_writable.wait(lock, [this]() { return !m_writer && m_readers == 0; });
+            --m_waiting;
+            m_writer = true;
+        }
+
+        void unlock()
+        {
+            std::lock_guard<std::mutex> lock { m_mutex };
+            m_writer = false;
+            if (m_waiting != 0)
+            {
+                m_writable.notify_one();
+            }
+            else
+            {
+                m_readable.notify_all();
+            }
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_readable;
+        std::condition_variable m_writable;
+        size_t m_readers { 0 };
+        size_t m_waiting { 0 };
+        bool m_writer { false };
+    };
+#endif
+
+    // Fixed size array of default constructed elements aligned as T requires,
+    // also beyond the alignment operator new guarantees before C++17.
+    template <typename T>
+    class AlignedArray
+    {
+    public:
+        explicit AlignedArray(size_t size)
+            : m_storage{new char[size * sizeof(T) + alignof(T) - 1]}
+        {
+            auto address = reinterpret_cast<uintptr_t>(m_storage.get());
+            m_data = reinterpret_cast<T*>((address + alignof(T) - 1) & ~static_cast<uintptr_t>(alignof(T) - 1));
+            try
+            {
+                for (; m_size < size; ++m_size)
+                {
+                    new (m_data + m_size) T{};
+                }
+            }
+            catch (...)
+            {
+                destroy();
+                throw;
+            }
+        }
+
+        AlignedArray(const AlignedArray&) = delete;
+        AlignedArray& operator=(const AlignedArray&) = delete;
+
+        ~AlignedArray()
+        {
+            destroy();
+        }
+
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        T& operator[](size_t i)
+        {
+            return m_data[i];
+        }
+
+        const T& operator[](size_t i) const
+        {
+            return m_data[i];
+        }
+
+        T* begin()
+        {
+            return m_data;
+        }
+
+        T* end()
+        {
+            return m_data + m_size;
+        }
+
+        const T* begin() const
+        {
+            return m_data;
+        }
+
+        const T* end() const
+        {
+            return m_data + m_size;
+        }
+
+    private:
+        void destroy()
+        {
+            while (m_size > 0)
+            {
+                m_data[--m_size].~T();
+            }
+        }
+
+        std::unique_ptr<char[]> m_storage;
+        T* m_data { nullptr };
+        size_t m_size { 0 };
+    };
+
+    template <typename M>
+    class SharedLock
+    {
+    public:
+        explicit SharedLock(M& mutex)
+            : m_mutex(mutex)
+        {
+            m_mutex.lock_shared();
+        }
+
+        SharedLock(const SharedLock&) = delete;
+        SharedLock& operator=(const SharedLock&) = delete;
+
+        ~SharedLock()
+        {
+            m_mutex.unlock_shared();
+        }
+
+    private:
+        M& m_mutex;
+    };
+}
+
+template <typename = void>
+class Reader
+{
+public:
+    Reader(const std::string& name, size_t blockSize = 1024 * 1024)
+        : m_input{utils::open_input(name)}
+        , m_buffer(blockSize > 0 ? blockSize : 1)
+    { }
+
+    bool getLine(const char*& line, size_t& size)
+    {
+        for (;;)
+        {
+            const char* begin = m_buffer.data() + m_begin;
+            auto eol = static_cast<const char*>(std::memchr(begin, '\n', m_end - m_begin));
+            if (eol != nullptr)
+            {
+                line = begin;
+                size = eol - begin;
+                m_begin += size + 1;
+                return true;
+            }
+            if (m_eof)
+            {
+                if (m_begin == m_end)
+                {
+                    return false;
+                }
+                line = begin;
+                size = m_end - m_begin;
+                m_begin = m_end;
+                return true;
+            }
+            fill();
+        }
+    }
+
+    bool getLine(std::string& line)
+    {
+        const char* data { nullptr };
+        size_t size { 0 };
+        if (!getLine(data, size))
+        {
+            return false;
+        }
+        line.assign(data, size);
+        return true;
+    }
+
+private:
+    void fill()
+    {
+        size_t rest = m_end - m_begin;
+        if (m_begin > 0)
+        {
+            std::memmove(m_buffer.data(), m_buffer.data() + m_begin, rest);
+        }
+        m_begin = 0;
+        m_end = rest;
+        if (m_end == m_buffer.size())
+        {
+            m_buffer.resize(m_buffer.size() * 2);
+        }
+
+        size_t read { 0 };
+        if (m_input)
+        {
+            read = m_input->read(m_buffer.data() + m_end, m_buffer.size() - m_end);
+        }
+        m_end += read;
+        m_eof = read == 0;
+    }
+
+    std::unique_ptr<utils::Input> m_input;
+    std::vector<char> m_buffer;
+    size_t m_begin { 0 };
+    size_t m_end { 0 };
+    bool m_eof { false };
+};
+
+template <typename = void>
+class StreamReader
+{
+public:
+    StreamReader(std::istream& input)
+        : m_input(input)
+    { }
+
+    bool getLine(std::string& line)
+    {
+        return static_cast<bool>(std::getline(m_input, line));
+    }
+
+private:
+    std::istream& m_input;
+};
+
+template <typename = void>
+class BufferReader
+{
+public:
+    BufferReader(const char* data, size_t size)
+        : m_position{data}
+        , m_end{data + size}
+    { }
+
+    bool getLine(const char*& line, size_t& size)
+    {
+        if (m_position == m_end)
+        {
+            return false;
+        }
+        auto eol = static_cast<const char*>(std::memchr(m_position, '\n', m_end - m_position));
+        line = m_position;
+        if (eol == nullptr)
+        {
+            size = m_end - m_position;
+            m_position = m_end;
+        }
+        else
+        {
+            size = eol - m_position;
+            m_position = eol + 1;
+        }
+        return true;
+    }
+
+private:
+    const char* m_position;
+    const char* m_end;
+};
+
+template <typename = void>
+class Writer
+{
+public:
+    Writer(const std::string& name)
+        : m_buffer{utils::open_output(name)}
+        , m_stream{m_buffer.get()}
+    { }
+
+    bool is_open() const
+    {
+        return m_buffer != nullptr;
+    }
+
+    template <typename T>
+    std::ostream& operator<<(const T& t)
+    {
+        return m_stream << t;
+    }
+
+    // Writes all output to the file, false if anything failed to be written.
+    bool close()
+    {
+        if (!m_buffer)
+        {
+            return false;
+        }
+        m_stream.flush();
+        return m_buffer->close() && !m_stream.fail();
+    }
+
+private:
+    std::unique_ptr<utils::OutputBuffer> m_buffer;
+    std::ostream m_stream;
+};
+
+template <typename R, typename W>
+class ConfigImpl : private utils::Parent
+{
+public:
+    using Entries = std::map<std::string, Entry<0>, utils::KeyLess>;
+    using iterator = Entries::iterator;
+    using const_iterator = Entries::const_iterator;
+
+    ConfigImpl() = default;
+
+    ~ConfigImpl()
+    {
+        unbind();
+    }
+
+    ConfigImpl(const ConfigImpl& other)
+        : m_entries{other.m_entries}
+        , m_sum{other.m_sum}
+        , m_count{other.m_count}
+        , m_interpolation{other.m_interpolation ? new Interpolation{*other.m_interpolation} : nullptr}
+        , m_frozen{other.m_frozen}
+    {
+        adoptAll();
+        if (m_frozen)
+        {
+            place();
+        }
+    }
+
+    ConfigImpl(ConfigImpl&& other)
+        : m_entries{std::move(other.m_entries)}
+        , m_handles{std::move(other.m_handles)}
+        , m_unbound{other.m_unbound}
+        , m_sum{other.m_sum}
+        , m_count{other.m_count}
+        , m_interpolation{std::move(other.m_interpolation)}
+        , m_frozen{std::move(other.m_frozen)}
+        , m_slots{std::move(other.m_slots)}
+    {
+        other.m_sum = 0;
+        other.m_count = 0;
+        adoptAll();
+    }
+
+    ConfigImpl& operator=(const ConfigImpl& other)
+    {
+        if (this != &other)
+        {
+            m_interpolation.reset();
+            thaw();
+            // Fresh nodes: assigning into the old ones would notify this
+            // config while its map is half copied.
+            m_entries.clear();
+            m_entries = other.m_entries;
+            m_sum = other.m_sum;
+            m_count = other.m_count;
+            m_interpolation.reset(other.m_interpolation ? new Interpolation{*other.m_interpolation} : nullptr);
+            adoptAll();
+            rebind();
+            m_frozen = other.m_frozen;
+            if (m_frozen)
+            {
+                place();
+            }
+        }
+        return *this;
+    }
+
+    ConfigImpl& operator=(ConfigImpl&& other)
+    {
+        if (this != &other)
+        {
+            m_interpolation.reset();
+            thaw();
+            m_entries = std::move(other.m_entries);
+            m_sum = other.m_sum;
+            other.m_sum = 0;
+            m_count = other.m_count;
+            other.m_count = 0;
+            m_interpolation = std::move(other.m_interpolation);
+            adoptAll();
+            m_handles.insert(m_handles.end(), other.m_handles.begin(), other.m_handles.end());
+            other.m_handles.clear();
+            rebind();
+            m_frozen = std::move(other.m_frozen);
+            m_slots = std::move(other.m_slots);
+        }
+        return *this;
+    }
+
+    template <typename = void>
+    Entry<0>& operator[](const std::string& name)
+    {
+        return insert(name);
+    }
+
+    template <typename = void>
+    Entry<0>& operator[](std::string&& name)
+    {
+        return insert(std::move(name));
+    }
+
+    // Merges other into this config as if other was loaded after it: keys
+    // of other override existing ones, sections are merged key by key.
+    template <typename = void>
+    void merge(ConfigImpl&& other)
+    {
+        for (auto& e : other.m_entries)
+        {
+            if (!e.second.section())
+            {
+                (*this)[e.first] = e.second.take<utils::Raw<>>();
+                continue;
+            }
+            auto& section = (*this)[e.first];
+            for (auto& kv : e.second)
+            {
+                section[kv.first] = kv.second.take<utils::Raw<>>();
+            }
+        }
+    }
+
+    template <typename = void>
+    void merge(const ConfigImpl& other)
+    {
+        merge(ConfigImpl{other});
+    }
+
+    uint64_t fingerprint() const
+    {
+        return m_sum;
+    }
+
+    // Expands ${section:key} and ${key} references in all values. Expanded
+    // values are stored in place, so reading them costs the same as reading
+    // plain values; assigning a referenced key re-expands only the values
+    // depending on it. Values on a reference cycle keep their text and false
+    // is returned.
+    template <typename = void>
+    bool interpolate()
+    {
+        m_interpolation.reset(new Interpolation{});
+        auto scan = [this](const std::string& section, const std::string& key, const Value& value)
+        {
+            if (!value.m_native && value.m_raw.find("${") != std::string::npos)
+            {
+                interpolation_track(Name{section, key}, value.m_raw);
+            }
+        };
+        for (const auto& e : m_entries)
+        {
+            if (!e.second.section())
+            {
+                scan({}, e.first, e.second);
+                continue;
+            }
+            for (const auto& kv : e.second)
+            {
+                scan(e.first, kv.first, kv.second);
+            }
+        }
+
+        std::map<Name, int> state;
+        for (const auto& source : m_interpolation->sources)
+        {
+            state.emplace(source.first, 0);
+        }
+        bool resolved { true };
+        for (const auto& source : m_interpolation->sources)
+        {
+            resolved = interpolation_resolve(source.first, state) && resolved;
+        }
+        return resolved;
+    }
+
+    // Compares fingerprints and counts in O(1); diff(a, b, true) compares
+    // the contents.
+    bool operator==(const ConfigImpl& other) const
+    {
+        return m_sum == other.m_sum && m_count == other.m_count;
+    }
+
+    bool operator!=(const ConfigImpl& other) const
+    {
+        return !(*this == other);
+    }
+
+    iterator find(utils::KeyView name)
+    {
+        return m_entries.find(name);
+    }
+
+    const_iterator find(utils::KeyView name) const
+    {
+        return m_entries.find(name);
+    }
+
+    utils::Range<iterator> prefix(const std::string& prefix)
+    {
+        return utils::prefix_range(m_entries, prefix);
+    }
+
+    utils::Range<const_iterator> prefix(const std::string& prefix) const
+    {
+        return utils::prefix_range(m_entries, prefix);
+    }
+
+    std::vector<iterator> glob(const std::string& pattern)
+    {
+        return utils::glob_range(m_entries, pattern);
+    }
+
+    std::vector<const_iterator> glob(const std::string& pattern) const
+    {
+        return utils::glob_range(m_entries, pattern);
+    }
+
+    template <typename = void>
+    std::vector<std::string> children(const std::string& section = {}) const
+    {
+        const std::string prefix { section.empty() ? section : section + '.' };
+        std::vector<std::string> names;
+        auto range = utils::prefix_range(m_entries, prefix);
+        for (auto it = range.begin(); it != range.end();)
+        {
+            if (!it->second.section())
+            {
+                ++it;
+                continue;
+            }
+            auto dot = it->first.find('.', prefix.size());
+            names.push_back(it->first.substr(0, dot));
+            if (dot == std::string::npos)
+            {
+                ++it;
+            }
+            else
+            {
+                auto next = utils::prefix_successor(names.back() + '.');
+                it = m_entries.lower_bound(next);
+            }
+        }
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+        return names;
+    }
+
+    template <typename = void>
+    Handle handle(const std::string& key)
+    {
+        return handle(std::string{}, key);
+    }
+
+    template <typename = void>
+    Handle handle(const std::string& section, const std::string& key)
+    {
+        std::shared_ptr<Handle::Slot> slot { new Handle::Slot{section, key, get(section, key)} };
+        m_unbound = m_unbound || slot->value == nullptr;
+        m_handles.push_back(slot);
+        return Handle{slot};
+    }
+
+    // Builds a minimal perfect hash over all keys, after which get() costs
+    // one hash and one key comparison. Any insertion of a key or section
+    // drops the index; assigning values keeps it.
+    template <typename = void>
+    bool freeze()
+    {
+        std::vector<uint64_t> hashes;
+        hashes.reserve(m_count);
+        visit_keys([&hashes](const std::string* section, const std::string& key, const Entry<0>&, const Value&)
+        {
+            hashes.push_back(name_hash(section ? *section : std::string{}, key));
+        });
+        std::shared_ptr<utils::PerfectHash> index { new utils::PerfectHash{} };
+        if (!index->build(hashes))
+        {
+            thaw();
+            return false;
+        }
+        m_frozen = std::move(index);
+        return place();
+    }
+
+    // Freezes with an index returned by frozen_index() for the same keys,
+    // skipping the build. Fails when the index does not fit the keys.
+    template <typename = void>
+    bool freeze(const std::string& index)
+    {
+        std::shared_ptr<utils::PerfectHash> frozen { new utils::PerfectHash{} };
+        if (!frozen->deserialize(index))
+        {
+            thaw();
+            return false;
+        }
+        m_frozen = std::move(frozen);
+        return place();
+    }
+
+    bool frozen() const
+    {
+        return m_frozen != nullptr;
+    }
+
+    // The serialized index, empty when not frozen.
+    std::string frozen_index() const
+    {
+        return m_frozen ? m_frozen->serialize() : std::string{};
+    }
+
+    // Returns the value of a key without inserting it, nullptr when missing.
+    template <typename = void>
+    const Value* get(utils::KeyView section, utils::KeyView key) const
+    {
+        if (m_frozen)
+        {
+            if (m_slots.empty())
+            {
+                return nullptr;
+            }
+            auto hash = name_hash(section, key);
+            const auto& slot = m_slots[m_frozen->position(hash)];
+            if (slot.hash != hash || *slot.key != key
+                || (slot.section ? *slot.section != section : !section.empty()))
+            {
+                return nullptr;
+            }
+            return slot.value;
+        }
+        if (section.empty())
+        {
+            auto it = m_entries.find(key);
+            return it != m_entries.end() && !it->second.section() ? &it->second : nullptr;
+        }
+        auto it = m_entries.find(section);
+        if (it == m_entries.end() || !it->second.section())
+        {
+            return nullptr;
+        }
+        auto kv = it->second.find(key);
+        return kv != it->second.end() ? &kv->second : nullptr;
+    }
+
+    template <typename = void>
+    const Value* get(utils::KeyView key) const
+    {
+        return get({}, key);
+    }
+
+    size_t count() const
+    {
+        return m_count;
+    }
+
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage usage;
+        usage.overhead = sizeof(*this);
+        for (const auto& e : m_entries)
+        {
+            usage.keys += utils::heap_bytes(e.first);
+            usage.overhead += utils::node_bytes<std::pair<const std::string, Entry<0>>>();
+            usage += e.second.memory_usage();
+        }
+        return usage;
+    }
+
+    // Writes the bytes used by each section and key without section, largest
+    // first.
+    template <typename = void>
+    void memory_report(std::ostream& os) const
+    {
+        std::vector<std::pair<size_t, const_iterator>> usage;
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+        {
+            usage.emplace_back(it->second.memory_usage().total() + utils::heap_bytes(it->first)
+                + utils::node_bytes<std::pair<const std::string, Entry<0>>>(), it);
+        }
+        std::stable_sort(usage.begin(), usage.end(), [](const std::pair<size_t, const_iterator>& a, const std::pair<size_t, const_iterator>& b)
+        {
+            return a.first > b.first;
+        });
+        for (const auto& u : usage)
+        {
+            os << u.first << '\t';
+            if (u.second->second.section())
+            {
+                os << '[' << u.second->first << ']';
+            }
+            else
+            {
+                os << u.second->first;
+            }
+            os << '\n';
+        }
+    }
+
+    // Reclaims the spare capacity left by loading and updates: the entries
+    // are rebuilt in order so that the nodes of a section and its values are
+    // allocated next to each other, and values are shrunk to their size.
+    // Iterators and references are invalidated, handles are kept.
+    template <typename = void>
+    void compact()
+    {
+        Entries entries;
+        for (auto& e : m_entries)
+        {
+            auto it = entries.emplace_hint(entries.end(), std::string{e.first}, std::move(e.second));
+            it->second.compact();
+        }
+        m_entries = std::move(entries);
+        adoptAll();
+        rebind();
+        if (m_frozen)
+        {
+            place();
+        }
+    }
+
+    iterator begin()
+    {
+        return m_entries.begin();
+    }
+
+    iterator end()
+    {
+        return m_entries.end();
+    }
 
     const_iterator begin() const
     {
-        return m_kv.cbegin();
+        return m_entries.cbegin();
+    }
+
+    const_iterator end() const
+    {
+        return m_entries.cend();
+    }
+
+    template <typename = void>
+    bool save(const std::string& fileName, SaveFlags flags = SaveFlag_Default) const
+    {
+        W writer{fileName};
+        if (!writer.is_open())
+        {
+            return false;
+        }
+        for (const auto& e : m_entries)
+        {
+            if (e.second.section())
+            {
+                continue;
+            }
+            if ((flags & SaveFlag_SkipEmptyKeys) && e.second.empty())
+            {
+                continue;
+            }
+
+            writer << e.first << '=' << saved({}, e.first, e.second) << '\n';
+        }
+        if (flags & SaveFlag_Parallel)
+        {
+            save_parallel(writer, flags);
+        }
+        else
+        {
+            for (const auto& e : m_entries)
+            {
+                if (!saved_section(e.second, flags))
+                {
+                    continue;
+                }
+                save_section(writer, e.first, e.second, flags);
+            }
+        }
+        return close(writer, typename traits::has_close<W>::type{});
+    }
+
+#ifdef SIMPLEINI_ACCESS_TRACKING
+    template <typename = void>
+    std::vector<AccessStat> access_stats() const
+    {
+        std::vector<AccessStat> stats;
+        for (const auto& e : m_entries)
+        {
+            if (!e.second.section())
+            {
+                stats.push_back({std::string{}, e.first, e.second.reads()});
+                continue;
+            }
+            for (const auto& c : e.second)
+            {
+                stats.push_back({e.first, c.first, c.second.reads()});
+            }
+        }
+        std::stable_sort(stats.begin(), stats.end(), [](const AccessStat& a, const AccessStat& b)
+        {
+            return a.reads > b.reads;
+        });
+        return stats;
+    }
+
+    template <typename = void>
+    void access_report(std::ostream& os) const
+    {
+        for (const auto& stat : access_stats())
+        {
+            os << stat.reads << '\t';
+            if (!stat.section.empty())
+            {
+                os << '[' << stat.section << "] ";
+            }
+            os << stat.key << '\n';
+        }
+    }
+
+    void reset_access_stats() const
+    {
+        for (const auto& e : m_entries)
+        {
+            e.second.reset_reads();
+            for (const auto& c : e.second)
+            {
+                c.second.reset_reads();
+            }
+        }
+    }
+#endif
+
+    template<typename = void>
+    static ConfigImpl load(const std::string& file, LoadFlags flags = LoadFlag_Default)
+    {
+        R reader{file};
+        Context context;
+        context.includes = (flags & LoadFlag_Includes) != 0;
+        context.directory = utils::directory_of(file);
+        context.stack.push_back(utils::absolute_path(file));
+        return read(reader, context);
+    }
+
+    template<typename = void>
+    static ConfigImpl load(std::istream& input, LoadFlags flags = LoadFlag_Default)
+    {
+        StreamReader<> reader{input};
+        Context context;
+        context.includes = (flags & LoadFlag_Includes) != 0;
+        return read(reader, context);
+    }
+
+    template<typename = void>
+    static ConfigImpl load_from_buffer(const char* data, size_t size, LoadFlags flags = LoadFlag_Default)
+    {
+        BufferReader<> reader{data, size};
+        Context context;
+        context.includes = (flags & LoadFlag_Includes) != 0;
+        return read(reader, context);
+    }
+
+    // Loads every file of directory matching pattern on up to threads
+    // threads (0 - one per hardware thread) and merges them in file name
+    // order, later files overriding keys of earlier ones.
+    template <typename = void>
+    static ConfigImpl load_directory(const std::string& directory, const std::string& pattern = "*.ini", unsigned threads = 0, LoadFlags flags = LoadFlag_Default)
+    {
+        auto names = utils::list_directory(directory, pattern);
+        std::vector<ConfigImpl> fragments(names.size());
+        std::atomic<size_t> next { 0 };
+        auto worker = [&]()
+        {
+            for (size_t i = next++; i < names.size(); i = next++)
+            {
+                fragments[i] = load(directory + '/' + names[i], flags);
+            }
+        };
+
+        threads = pool_size(threads, names.size());
+        std::vector<std::future<void>> workers;
+        for (unsigned i = 1; i < threads; ++i)
+        {
+            workers.push_back(std::async(std::launch::async, worker));
+        }
+        worker();
+        for (auto& w : workers)
+        {
+            w.get();
+        }
+
+        ConfigImpl config;
+        for (auto& fragment : fragments)
+        {
+            config.merge(std::move(fragment));
+        }
+        return config;
+    }
+
+    template <typename = void>
+    static std::future<ConfigImpl> load_async(const std::string& file, LoadFlags flags = LoadFlag_Default)
+    {
+        return std::async(std::launch::async, [file, flags]()
+        {
+            return load(file, flags);
+        });
+    }
+
+    template <typename Executor, typename Callback>
+    static void load_async(const std::string& file, Executor&& executor, Callback&& callback, LoadFlags flags = LoadFlag_Default)
+    {
+        typename std::decay<Callback>::type done { std::forward<Callback>(callback) };
+        executor([file, done, flags]() mutable
+        {
+            done(load(file, flags));
+        });
+    }
+
+    // Loads files on up to threads threads (0 - one per hardware thread),
+    // worker w taking files w, w + threads, ... in order; the future of each
+    // file is ready as soon as it is loaded. The future of the last file of
+    // a worker is the worker itself, so dropping the futures waits for the
+    // loads instead of leaving them running.
+    template <typename = void>
+    static std::vector<std::future<ConfigImpl>> load_all_async(const std::vector<std::string>& files, unsigned threads = 0, LoadFlags flags = LoadFlag_Default)
+    {
+        struct Batch
+        {
+            std::vector<std::string> files;
+            std::vector<std::promise<ConfigImpl>> configs;
+        };
+        std::shared_ptr<Batch> batch { new Batch{} };
+        batch->files = files;
+        batch->configs.resize(files.size());
+
+        std::vector<std::future<ConfigImpl>> configs(files.size());
+        threads = pool_size(threads, files.size());
+        for (unsigned w = 0; w < threads; ++w)
+        {
+            size_t last = w + (files.size() - 1 - w) / threads * threads;
+            for (size_t i = w; i < last; i += threads)
+            {
+                configs[i] = batch->configs[i].get_future();
+            }
+            configs[last] = std::async(std::launch::async, [batch, w, last, threads, flags]()
+            {
+                for (size_t i = w; i < last; i += threads)
+                {
+                    try
+                    {
+                        batch->configs[i].set_value(load(batch->files[i], flags));
+                    }
+                    catch (...)
+                    {
+                        batch->configs[i].set_exception(std::current_exception());
+                    }
+                }
+                return load(batch->files[last], flags);
+            });
+        }
+        return configs;
+    }
+
+private:
+    // Threads used for count tasks when asked for threads, 0 meaning one per
+    // hardware thread.
+    static unsigned pool_size(unsigned threads, size_t count)
+    {
+        if (threads == 0)
+        {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        return static_cast<unsigned>(std::min<size_t>(threads, count));
+    }
+
+    struct Context
+    {
+        std::string directory;
+        std::vector<std::string> stack;
+        std::vector<utils::FileStamp> files;
+        bool includes { false };
+        bool cyclic { false };
+    };
+
+    struct Fragment
+    {
+        std::vector<utils::FileStamp> files;
+        std::shared_ptr<const ConfigImpl> config;
+        uint64_t used;
+    };
+
+    template <typename Source>
+    static ConfigImpl read(Source& source, Context& context)
+    {
+        return read(source, context, typename traits::has_line_view<Source>::type{});
+    }
+
+    template <typename Source>
+    static ConfigImpl read(Source& source, Context& context, std::true_type)
+    {
+        ConfigImpl config;
+        std::string section;
+        const char* line { nullptr };
+        size_t size { 0 };
+        while (source.getLine(line, size))
+        {
+            parseLine(config, section, line, size, context);
+        }
+        return config;
+    }
+
+    template <typename Source>
+    static ConfigImpl read(Source& source, Context& context, std::false_type)
+    {
+        ConfigImpl config;
+        std::string section;
+        std::string line;
+        while (source.getLine(line))
+        {
+            parseLine(config, section, line.data(), line.size(), context);
+        }
+        return config;
+    }
+
+    static void parseLine(ConfigImpl& config, std::string& section, const char* line, size_t size, Context& context)
+    {
+        if (size == 0)
+        {
+            return;
+        }
+
+        if (line[0] == '[')
+        {
+            auto e = static_cast<const char*>(std::memchr(line, ']', size));
+            if (e != nullptr)
+            {
+                section.assign(line + 1, e);
+                return;
+            }
+        }
+
+        size_t beg { 0 };
+        while (beg < size && (line[beg] == ' ' || line[beg] == '\t'))
+        {
+            ++beg;
+        }
+        if (beg == size)
+        {
+            return;
+        }
+
+        if (line[beg] == '#' || line[beg] == ';')
+        {
+            return;
+        }
+
+        static const char directive[] = "@include";
+        const size_t length = sizeof(directive) - 1;
+        if (context.includes && line[beg] == '@' && size - beg > length && std::memcmp(line + beg, directive, length) == 0
+            && (line[beg + length] == ' ' || line[beg + length] == '\t'))
+        {
+            include(config, section, std::string{line + beg + length, line + size}, context);
+            return;
+        }
+
+        auto sep = static_cast<const char*>(std::memchr(line + beg, '=', size - beg));
+        if (sep == nullptr)
+        {
+            return;
+        }
+
+        std::string key { line + beg, sep };
+        utils::Raw<> value { std::string{sep + 1, line + size} };
+
+        if (section.empty())
+        {
+            config[std::move(key)] = std::move(value);
+        }
+        else
+        {
+            config[section][std::move(key)] = std::move(value);
+        }
+    }
+
+    static void include(ConfigImpl& config, const std::string& section, std::string path, Context& context)
+    {
+        auto first = path.find_first_not_of(" \t\"");
+        auto last = path.find_last_not_of(" \t\r\"");
+        if (first == std::string::npos)
+        {
+            return;
+        }
+        path = path.substr(first, last - first + 1);
+        if (!utils::is_absolute(path))
+        {
+            path = context.directory + path;
+        }
+
+        auto fragment = load_fragment(path, context);
+        if (!fragment)
+        {
+            return;
+        }
+        for (const auto& e : fragment->m_entries)
+        {
+            if (!e.second.section())
+            {
+                utils::Raw<> value { e.second.raw() };
+                if (section.empty())
+                {
+                    config[e.first] = std::move(value);
+                }
+                else
+                {
+                    config[section][e.first] = std::move(value);
+                }
+                continue;
+            }
+            auto& target = config[e.first];
+            for (const auto& kv : e.second)
+            {
+                target[kv.first] = utils::Raw<>{kv.second.raw()};
+            }
+        }
+    }
+
+    // Returns the parsed file, reusing the copy parsed earlier in the process
+    // while none of the files it was built from changed.
+    static std::shared_ptr<const ConfigImpl> load_fragment(const std::string& path, Context& context)
+    {
+        auto absolute = utils::absolute_path(path);
+        if (absolute.empty())
+        {
+            return nullptr;
+        }
+        if (std::find(context.stack.begin(), context.stack.end(), absolute) != context.stack.end())
+        {
+            context.cyclic = true;
+            return nullptr;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock { fragmentsMutex() };
+            auto it = fragments().find(absolute);
+            if (it != fragments().end() && std::all_of(it->second.files.begin(), it->second.files.end(), [](const utils::FileStamp& f)
+                {
+                    return f.current();
+                }))
+            {
+                it->second.used = ++fragmentsUsed();
+                context.files.insert(context.files.end(), it->second.files.begin(), it->second.files.end());
+                return it->second.config;
+            }
+        }
+
+        Context nested;
+        nested.includes = true;
+        nested.directory = utils::directory_of(absolute);
+        nested.stack = context.stack;
+        nested.stack.push_back(absolute);
+        nested.files.push_back(utils::stamp(absolute));
+
+        R reader{absolute};
+        std::shared_ptr<const ConfigImpl> config { new ConfigImpl{read(reader, nested)} };
+
+        context.files.insert(context.files.end(), nested.files.begin(), nested.files.end());
+        if (nested.cyclic)
+        {
+            context.cyclic = true;
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock { fragmentsMutex() };
+            auto& cache = fragments();
+            cache[absolute] = Fragment{nested.files, config, ++fragmentsUsed()};
+            if (cache.size() > SIMPLEINI_INCLUDE_CACHE_SIZE)
+            {
+                cache.erase(std::min_element(cache.begin(), cache.end(), [](const typename Fragments::value_type& a, const typename Fragments::value_type& b)
+                {
+                    return a.second.used < b.second.used;
+                }));
+            }
+        }
+        return config;
+    }
+
+    using Fragments = std::map<std::string, Fragment>;
+
+    static Fragments& fragments()
+    {
+        static Fragments cache;
+        return cache;
+    }
+
+    static uint64_t& fragmentsUsed()
+    {
+        static uint64_t used { 0 };
+        return used;
+    }
+
+    static std::mutex& fragmentsMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    // Points the handles at their keys, or at nothing when missing.
+    void rebind()
+    {
+        m_unbound = false;
+        auto expired = std::remove_if(m_handles.begin(), m_handles.end(), [this](const std::weak_ptr<Handle::Slot>& h)
+        {
+            auto slot = h.lock();
+            if (slot)
+            {
+                slot->value = get(slot->section, slot->key);
+                m_unbound = m_unbound || slot->value == nullptr;
+            }
+            return !slot;
+        });
+        m_handles.erase(expired, m_handles.end());
+    }
+
+    void unbind()
+    {
+        for (const auto& h : m_handles)
+        {
+            if (auto slot = h.lock())
+            {
+                slot->value = nullptr;
+            }
+        }
+        m_handles.clear();
+    }
+
+    // Keys were added or removed: the frozen index is dropped, and handles
+    // are rebound when their key may have gone or may have appeared.
+    void reshaped(long delta)
+    {
+        m_count += delta;
+        thaw();
+        if (!m_handles.empty() && (delta <= 0 || m_unbound))
+        {
+            rebind();
+        }
+    }
+
+    template <typename K>
+    Entry<0>& insert(K&& name)
+    {
+        auto it = m_entries.lower_bound(name);
+        if (it == m_entries.end() || it->first != name)
+        {
+            it = m_entries.emplace_hint(it, std::forward<K>(name), Entry<0>{});
+            it->second.attach(this, it->first);
+            reshaped(1);
+        }
+        return it->second;
+    }
+
+    void adoptAll()
+    {
+        for (auto& e : m_entries)
+        {
+            e.second.adopt(this);
+        }
+    }
+
+    void updated(uint64_t before, uint64_t after) override
+    {
+        m_sum += after - before;
+    }
+
+    void resized(long delta) override
+    {
+        reshaped(delta);
+    }
+
+    struct FrozenSlot
+    {
+        uint64_t hash;
+        const std::string* section;
+        const std::string* key;
+        const Value* value;
+    };
+
+    // Calls f(section, key, entry, value) for each key, section being
+    // nullptr for keys without section.
+    template <typename F>
+    void visit_keys(F f) const
+    {
+        for (const auto& e : m_entries)
+        {
+            if (!e.second.section())
+            {
+                f(nullptr, e.first, e.second, e.second);
+                continue;
+            }
+            for (const auto& kv : e.second)
+            {
+                f(&e.first, kv.first, e.second, kv.second);
+            }
+        }
+    }
+
+    // Puts each key at its position in the frozen index.
+    bool place()
+    {
+        m_slots.assign(m_count, FrozenSlot{0, nullptr, nullptr, nullptr});
+        bool placed { m_frozen->size() == m_count };
+        visit_keys([this, &placed](const std::string* section, const std::string& key, const Entry<0>&, const Value& value)
+        {
+            auto hash = name_hash(section ? *section : std::string{}, key);
+            if (!placed)
+            {
+                return;
+            }
+            auto& slot = m_slots[m_frozen->position(hash)];
+            placed = slot.key == nullptr;
+            slot = FrozenSlot{hash, section, &key, &value};
+        });
+        if (!placed)
+        {
+            thaw();
+        }
+        return placed;
+    }
+
+    void thaw()
+    {
+        if (m_frozen)
+        {
+            m_frozen.reset();
+            m_slots.clear();
+        }
+    }
+
+    using Name = std::pair<std::string, std::string>;
+
+    struct Interpolation
+    {
+        std::map<Name, std::string> sources;
+        std::map<Name, std::vector<Name>> references;
+        std::map<Name, std::set<Name>> dependents;
+        std::multimap<uint64_t, Name> watched;
+    };
+
+    static uint64_t name_hash(utils::KeyView section, utils::KeyView key)
+    {
+        return section.empty() ? utils::hash_key(key) : utils::mix(utils::hash_key(section), utils::hash_key(key));
+    }
+
+    static uint64_t name_hash(const Name& name)
+    {
+        return name_hash(name.first, name.second);
+    }
+
+    // Parses the reference text[b..e] spelled ${section:key} or ${key}.
+    static Name reference(const std::string& text, size_t b, size_t e)
+    {
+        auto sep = text.find(':', b + 2);
+        if (sep == std::string::npos || sep > e)
+        {
+            return Name{{}, text.substr(b + 2, e - b - 2)};
+        }
+        return Name{text.substr(b + 2, sep - b - 2), text.substr(sep + 1, e - sep - 1)};
+    }
+
+    static std::vector<Name> references(const std::string& text)
+    {
+        std::vector<Name> names;
+        for (auto b = text.find("${"); b != std::string::npos; b = text.find("${", b))
+        {
+            auto e = text.find('}', b + 2);
+            if (e == std::string::npos)
+            {
+                break;
+            }
+            names.push_back(reference(text, b, e));
+            b = e + 1;
+        }
+        return names;
+    }
+
+    Value* lookup(const Name& name)
+    {
+        auto e = m_entries.find(name.first.empty() ? name.second : name.first);
+        if (e == m_entries.end())
+        {
+            return nullptr;
+        }
+        if (name.first.empty())
+        {
+            return e->second.section() ? nullptr : &e->second;
+        }
+        auto kv = e->second.find(name.second);
+        return kv == e->second.end() ? nullptr : &kv->second;
+    }
+
+    // Writers with close() report whether everything reached the file.
+    static bool close(W& writer, std::true_type)
+    {
+        return writer.close();
+    }
+
+    static bool close(W&, std::false_type)
+    {
+        return true;
+    }
+
+    static bool saved_section(const Entry<0>& entry, SaveFlags flags)
+    {
+        return entry.section() && !((flags & SaveFlag_SkipEmptyKeys) && entry.empty());
+    }
+
+    template <typename O>
+    void save_section(O& out, const std::string& name, const Entry<0>& section, SaveFlags flags) const
+    {
+        out << "\n[" << name << "]\n";
+        for (const auto& c : section)
+        {
+            if ((flags & SaveFlag_SkipEmptyKeys) && c.second.empty())
+            {
+                continue;
+            }
+            out << c.first << '=' << saved(name, c.first, c.second) << '\n';
+        }
+    }
+
+    // Sections are formatted into their own buffers by workers taking them
+    // in order, each buffer being written and released as soon as the ones
+    // before it are.
+    template <typename = void>
+    void save_parallel(W& writer, SaveFlags flags) const
+    {
+        std::vector<const_iterator> sections;
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+        {
+            if (saved_section(it->second, flags))
+            {
+                sections.push_back(it);
+            }
+        }
+        unsigned threads = static_cast<unsigned>(std::min<size_t>(std::thread::hardware_concurrency(), sections.size()));
+        if (threads < 2)
+        {
+            for (auto it : sections)
+            {
+                save_section(writer, it->first, it->second, flags);
+            }
+            return;
+        }
+
+        std::vector<utils::TextBuffer> buffers(sections.size());
+        std::vector<char> ready(sections.size());
+        std::mutex mutex;
+        std::condition_variable formatted;
+        std::atomic<size_t> next { 0 };
+        std::exception_ptr error;
+        auto worker = [&]()
+        {
+            for (size_t i = next++; i < sections.size(); i = next++)
+            {
+                try
+                {
+                    save_section(buffers[i], sections[i]->first, sections[i]->second, flags);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock { mutex };
+                    if (!error)
+                    {
+                        error = std::current_exception();
+                    }
+                    next = sections.size();
+                    formatted.notify_one();
+                    return;
+                }
+                std::lock_guard<std::mutex> lock { mutex };
+                ready[i] = 1;
+                formatted.notify_one();
+            }
+        };
+        std::vector<std::future<void>> workers;
+        for (unsigned i = 0; i < threads; ++i)
+        {
+            workers.push_back(std::async(std::launch::async, worker));
+        }
+        for (size_t i = 0; i < sections.size(); ++i)
+        {
+            {
+                std::unique_lock<std::mutex> lock { mutex };
+                formatted.wait(lock, [&ready, &error, i]() { return ready[i] != 0 || error; });
+                if (error)
+                {
+                    break;
+                }
+            }
+            writer << buffers[i].text;
+            std::string{}.swap(buffers[i].text);
+        }
+        for (auto& w : workers)
+        {
+            w.get();
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    const std::string& saved(const std::string& section, const std::string& key, const Value& value) const
+    {
+        if (m_interpolation && !m_interpolation->sources.empty())
+        {
+            auto it = m_interpolation->sources.find(Name{section, key});
+            if (it != m_interpolation->sources.end())
+            {
+                return it->second;
+            }
+        }
+        return value.raw();
+    }
+
+    void interpolation_watch(const Name& name)
+    {
+        auto hash = name_hash(name);
+        auto range = m_interpolation->watched.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second == name)
+            {
+                return;
+            }
+        }
+        m_interpolation->watched.emplace(hash, name);
+    }
+
+    void interpolation_track(const Name& name, const std::string& source)
+    {
+        auto& references = m_interpolation->references[name];
+        references = ConfigImpl::references(utils::decode_text(source));
+        for (const auto& reference : references)
+        {
+            m_interpolation->dependents[reference].insert(name);
+            interpolation_watch(reference);
+        }
+        m_interpolation->sources[name] = source;
+        interpolation_watch(name);
+    }
+
+    void interpolation_untrack(const Name& name)
+    {
+        auto it = m_interpolation->references.find(name);
+        if (it == m_interpolation->references.end())
+        {
+            return;
+        }
+        for (const auto& reference : it->second)
+        {
+            m_interpolation->dependents[reference].erase(name);
+        }
+        m_interpolation->references.erase(it);
+        m_interpolation->sources.erase(name);
+    }
+
+    // Expands name after the interpolated values it references, depth first.
+    // state holds the names still to expand: 0 pending, 1 in progress, 2 done.
+    bool interpolation_resolve(const Name& name, std::map<Name, int>& state)
+    {
+        auto it = state.find(name);
+        if (it == state.end() || it->second == 2)
+        {
+            return true;
+        }
+        if (it->second == 1)
+        {
+            return false;
+        }
+        auto references = m_interpolation->references.find(name);
+        if (references == m_interpolation->references.end())
+        {
+            it->second = 2;
+            return true;
+        }
+        it->second = 1;
+
+        bool resolved { true };
+        for (const auto& reference : references->second)
+        {
+            resolved = interpolation_resolve(reference, state) && resolved;
+        }
+        it->second = 2;
+
+        Value* value = lookup(name);
+        if (value == nullptr)
+        {
+            return resolved;
+        }
+        if (!resolved)
+        {
+            value->m_raw = m_interpolation->sources[name];
+            value->m_native.reset();
+            value->refresh();
+            return false;
+        }
+
+        std::string source { utils::decode_text(m_interpolation->sources[name]) };
+        std::string text;
+        size_t pos { 0 };
+        for (auto b = source.find("${"); b != std::string::npos; b = source.find("${", pos))
+        {
+            auto e = source.find('}', b + 2);
+            if (e == std::string::npos)
+            {
+                break;
+            }
+            text.append(source, pos, b - pos);
+            const Value* target = lookup(reference(source, b, e));
+            if (target != nullptr)
+            {
+                text += utils::decode_text(target->raw());
+            }
+            pos = e + 1;
+        }
+        text.append(source, pos, std::string::npos);
+        bool quoted { !m_interpolation->sources[name].empty() && m_interpolation->sources[name].front() == '\"' };
+        value->m_raw = quoted ? utils::encode_text(text) : std::move(text);
+        value->m_native.reset();
+        value->refresh();
+        return true;
     }
 
-    const_iterator end() const
+    void assigned(uint64_t hash) override
     {
-        return m_kv.cend();
-    }
+        if (!m_interpolation)
+        {
+            return;
+        }
+        auto range = m_interpolation->watched.equal_range(hash);
+        if (range.first == range.second)
+        {
+            return;
+        }
+        std::vector<Name> names;
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            names.push_back(it->second);
+        }
 
-private:
-    bool m_section { false };
-    std::map<std::string, Entry<1>> m_kv;
-};
+        std::map<Name, int> state;
+        std::vector<Name> pending;
+        for (const auto& name : names)
+        {
+            Value* value = lookup(name);
+            if (m_interpolation->sources.count(name))
+            {
+                interpolation_untrack(name);
+            }
+            if (value != nullptr && !value->m_native && value->m_raw.find("${") != std::string::npos)
+            {
+                interpolation_track(name, value->m_raw);
+                pending.push_back(name);
+            }
+            auto dependents = m_interpolation->dependents.find(name);
+            if (dependents != m_interpolation->dependents.end())
+            {
+                pending.insert(pending.end(), dependents->second.begin(), dependents->second.end());
+            }
+        }
+        while (!pending.empty())
+        {
+            Name name = std::move(pending.back());
+            pending.pop_back();
+            if (!state.emplace(name, 0).second)
+            {
+                continue;
+            }
+            auto dependents = m_interpolation->dependents.find(name);
+            if (dependents != m_interpolation->dependents.end())
+            {
+                pending.insert(pending.end(), dependents->second.begin(), dependents->second.end());
+            }
+        }
+        for (const auto& s : state)
+        {
+            interpolation_resolve(s.first, state);
+        }
+    }
 
-enum SaveFlags
-{
-    SaveFlag_Default = 0,
-    SaveFlag_SkipEmptyKeys = 0x01
+    Entries m_entries;
+    std::vector<std::weak_ptr<Handle::Slot>> m_handles;
+    bool m_unbound { false };
+    uint64_t m_sum { 0 };
+    size_t m_count { 0 };
+    std::unique_ptr<Interpolation> m_interpolation;
+    std::shared_ptr<const utils::PerfectHash> m_frozen;
+    std::vector<FrozenSlot> m_slots;
 };
 
-template <typename = void>
-class Reader
+// Config shared by threads which read and update keys concurrently. Entries
+// are spread over shards by the hash of their name, each shard guarded by its
+// own reader-writer lock, so that threads working on different sections
+// rarely wait for each other. Values are returned by copy, as references
+// would outlive the locks.
+template <typename R, typename W>
+class ConcurrentConfigImpl
 {
 public:
-    Reader(const std::string& name)
+    using Config = ConfigImpl<R, W>;
+
+    explicit ConcurrentConfigImpl(size_t shards = 64)
+        : m_shards(std::max<size_t>(1, shards))
+    { }
+
+    explicit ConcurrentConfigImpl(Config config, size_t shards = 64)
+        : ConcurrentConfigImpl(shards)
     {
-        m_input.open(name, std::ios::in);
+        for (auto& e : config)
+        {
+            shard(e.first).config[e.first] = std::move(e.second);
+        }
     }
 
-    bool getLine(std::string& line)
+    ConcurrentConfigImpl(const ConcurrentConfigImpl&) = delete;
+    ConcurrentConfigImpl& operator=(const ConcurrentConfigImpl&) = delete;
+
+    template <typename T>
+    T value(utils::KeyView section, utils::KeyView key, const T& defaultValue = T{}) const
     {
-        return static_cast<bool>(std::getline(m_input, line));
+#ifdef SIMPLEINI_STRING_VIEW
+        static_assert(!std::is_same<T, std::string_view>::value, "a view would outlive the lock of its shard");
+#endif
+        const auto& s = shard(section.empty() ? key : section);
+        utils::SharedLock<utils::SharedMutex> lock { s.mutex };
+        auto value = s.config.get(section, key);
+        return value ? value->template value<T>(defaultValue) : defaultValue;
     }
 
-private:
-    std::ifstream m_input;
-};
+    template <typename T>
+    T value(utils::KeyView key, const T& defaultValue = T{}) const
+    {
+        return value<T>({}, key, defaultValue);
+    }
 
-template <typename = void>
-class Writer
-{
-public:
-    Writer(const std::string& name)
+    template <typename = void>
+    bool contains(utils::KeyView section, utils::KeyView key) const
     {
-        m_stream.open(name, std::ios::trunc);
+        const auto& s = shard(section.empty() ? key : section);
+        utils::SharedLock<utils::SharedMutex> lock { s.mutex };
+        return s.config.get(section, key) != nullptr;
     }
 
-    bool is_open() const
+    template <typename T>
+    void set(const std::string& section, const std::string& key, T&& value)
     {
-        return m_stream.is_open();
+        auto& s = shard(section.empty() ? key : section);
+        std::lock_guard<utils::SharedMutex> lock { s.mutex };
+        if (section.empty())
+        {
+            s.config[key] = std::forward<T>(value);
+        }
+        else
+        {
+            s.config[section][key] = std::forward<T>(value);
+        }
     }
 
     template <typename T>
-    std::ostream& operator<<(const T& t)
+    void set(const std::string& key, T&& value)
     {
-        return m_stream << t;
+        set(std::string{}, key, std::forward<T>(value));
     }
 
-private:
-    std::ofstream m_stream;
-};
+    // Calls f(const Entry<0>*) with the section or key name, nullptr when
+    // missing, while holding the shared lock of its shard: several keys of a
+    // section are read consistently.
+    template <typename F>
+    void read(const std::string& name, F f) const
+    {
+        const auto& s = shard(name);
+        utils::SharedLock<utils::SharedMutex> lock { s.mutex };
+        auto it = s.config.find(name);
+        f(it != s.config.end() ? &it->second : nullptr);
+    }
 
-template <typename R, typename W>
-class ConfigImpl
-{
-public:
-    using iterator = std::map<std::string, Entry<0>>::iterator;
-    using const_iterator = std::map<std::string, Entry<0>>::const_iterator;
+    // Calls f(Entry<0>&) with the section or key name, inserted if missing,
+    // while holding the exclusive lock of its shard: several keys of a
+    // section are updated at once.
+    template <typename F>
+    void update(const std::string& name, F f)
+    {
+        auto& s = shard(name);
+        std::lock_guard<utils::SharedMutex> lock { s.mutex };
+        f(s.config[name]);
+    }
 
     template <typename = void>
-    Entry<0>& operator[](const std::string& name)
+    size_t count() const
     {
-        if (m_entries.find(name) == m_entries.end())
+        size_t count { 0 };
+        for (const auto& s : m_shards)
         {
-            m_entries[name] = {};
+            utils::SharedLock<utils::SharedMutex> lock { s.mutex };
+            count += s.config.count();
         }
-        return m_entries[name];
+        return count;
     }
 
-    size_t count() const
+    // Copies all entries into a plain config. Shards are copied one after
+    // the other, so updates of different sections running meanwhile may be
+    // seen partially.
+    template <typename = void>
+    Config snapshot() const
     {
-        size_t size { 0 };
-        for (const auto& e0 : m_entries)
+        Config config;
+        for (const auto& s : m_shards)
         {
-            size += e0.second.count();
+            utils::SharedLock<utils::SharedMutex> lock { s.mutex };
+            for (const auto& e : s.config)
+            {
+                config[e.first] = Entry<0>{e.second};
+            }
         }
-        return size;
+        return config;
     }
 
-    iterator begin()
+    template <typename = void>
+    bool save(const std::string& fileName, SaveFlags flags = SaveFlag_Default) const
     {
-        return m_entries.begin();
+        return snapshot().save(fileName, flags);
     }
 
-    iterator end()
+private:
+    // Aligned to cache lines, so that the lock of a shard does not share one
+    // with the neighbouring shards; AlignedArray keeps the alignment.
+    struct alignas(64) Shard
     {
-        return m_entries.end();
-    }
+        mutable utils::SharedMutex mutex;
+        Config config;
+    };
 
-    const_iterator begin() const
+    Shard& shard(utils::KeyView name)
     {
-        return m_entries.cbegin();
+        return m_shards[utils::hash_key(name) % m_shards.size()];
     }
 
-    const_iterator end() const
+    const Shard& shard(utils::KeyView name) const
     {
-        return m_entries.cend();
+        return m_shards[utils::hash_key(name) % m_shards.size()];
     }
 
-    template <typename = void>
-    bool save(const std::string& fileName, SaveFlags flags = SaveFlag_Default) const
+    utils::AlignedArray<Shard> m_shards;
+};
+
+// Config whose copies are O(1) and share everything but what is modified
+// afterwards, so that many versions of a config can be kept for rollback or
+// overrides: an update copies the tree nodes on the paths to its section
+// and key, O(log n) small nodes, and the assigned value. Values are read in
+// place, or converted to a plain config for saving, iteration and the rest
+// of the API.
+template <typename R, typename W>
+class PersistentConfigImpl
+{
+public:
+    using Config = ConfigImpl<R, W>;
+
+    PersistentConfigImpl() = default;
+
+    explicit PersistentConfigImpl(const Config& config)
     {
-        W writer{fileName};
-        if (!writer.is_open())
-        {
-            return false;
-        }
-        for (const auto& e : m_entries)
+        std::vector<std::pair<std::string, Item>> entries;
+        for (const auto& e : config)
         {
-            if (e.second.section())
+            Item item;
+            item.section = e.second.section();
+            item.exists = true;
+            if (!item.section)
             {
-                continue;
+                item.value = static_cast<const Value&>(e.second);
             }
-            if ((flags & SaveFlag_SkipEmptyKeys) && e.second.empty())
+            else
             {
-                continue;
+                std::vector<std::pair<std::string, Value>> keys;
+                for (const auto& kv : e.second)
+                {
+                    keys.emplace_back(kv.first, static_cast<const Value&>(kv.second));
+                }
+                item.keys = utils::PersistentMap<Value>{std::move(keys)};
             }
-
-            writer << e.first << '=' << e.second.value<utils::Raw<>>().value() << '\n';
+            m_count += item.section ? item.keys.size() : 1;
+            entries.emplace_back(e.first, std::move(item));
         }
-        for (const auto& e : m_entries)
+        m_entries = utils::PersistentMap<Item>{std::move(entries)};
+    }
+
+    // Returns the value of a key, nullptr when missing. The value lives as
+    // long as any version holding it.
+    const Value* get(utils::KeyView section, utils::KeyView key) const
+    {
+        auto item = m_entries.find(section.empty() ? key : section);
+        if (item == nullptr || item->section != !section.empty())
         {
-            if (!e.second.section())
-            {
-                continue;
-            }
+            return nullptr;
+        }
+        return section.empty() ? &item->value : item->keys.find(key);
+    }
 
-            if ((flags & SaveFlag_SkipEmptyKeys) && e.second.empty())
-            {
-                continue;
-            }
+    const Value* get(utils::KeyView key) const
+    {
+        return get({}, key);
+    }
 
-            writer << "\n[" << e.first << "]\n";
-            for (const auto& c : e.second)
-            {
-                if ((flags & SaveFlag_SkipEmptyKeys) && c.second.empty())
-                {
-                    continue;
-                }
-                writer << c.first << '=' << c.second.value<utils::Raw<>>().value() << '\n';
-            }
-        }
-        return true;
+    template <typename T>
+    T value(utils::KeyView section, utils::KeyView key, const T& defaultValue = T{}) const
+    {
+        auto value = get(section, key);
+        return value ? value->template value<T>(defaultValue) : defaultValue;
     }
 
-    template<typename = void>
-    static ConfigImpl load(const std::string& file)
+    template <typename T>
+    T value(utils::KeyView key, const T& defaultValue = T{}) const
     {
-        R reader{file};
+        return value<T>({}, key, defaultValue);
+    }
 
-        ConfigImpl config;
-        std::string line;
-        std::string section;
+    bool contains(utils::KeyView section, utils::KeyView key) const
+    {
+        return get(section, key) != nullptr;
+    }
 
-        while (reader.getLine(line))
+    // Assigns a key of this version only; like operator[] on a plain config,
+    // a key without section turns into a section when given keys and back.
+    template <typename T>
+    PersistentConfigImpl& set(const std::string& section, const std::string& key, T&& value)
+    {
+        long delta { 0 };
+        m_entries.update(section.empty() ? key : section, [&](Item& item)
         {
-            if (line.empty())
+            long before = item.section ? static_cast<long>(item.keys.size()) : item.exists;
+            if (section.empty())
             {
-                continue;
+                item = Item{};
+                item.value = std::forward<T>(value);
             }
-
-            if (line[0] == '[')
+            else
             {
-                size_t e = line.find(']');
-                if (e != std::string::npos)
+                if (!item.section)
                 {
-                    section = line.substr(1, e - 1);
-                    continue;
+                    item = Item{};
+                    item.section = true;
                 }
+                item.keys.update(key, [&value](Value& v)
+                {
+                    v = std::forward<T>(value);
+                });
             }
+            item.exists = true;
+            delta = (item.section ? static_cast<long>(item.keys.size()) : 1) - before;
+        });
+        m_count += delta;
+        return *this;
+    }
 
-            size_t beg = line.find_first_not_of(" \t");
-            if (beg == std::string::npos)
-            {
-                continue;
-            }
+    template <typename T>
+    PersistentConfigImpl& set(const std::string& key, T&& value)
+    {
+        return set(std::string{}, key, std::forward<T>(value));
+    }
 
-            if (line[beg] == '#' || line[beg] == ';')
-            {
-                continue;
-            }
+    size_t count() const
+    {
+        return m_count;
+    }
 
-            size_t sep = line.find('=', beg);
-            if (sep == std::string::npos)
+    template <typename = void>
+    Config config() const
+    {
+        Config config;
+        m_entries.for_each([&config](const std::string& name, const Item& item)
+        {
+            auto& entry = config[name];
+            if (!item.section)
             {
-                continue;
+                entry = item.value;
+                return;
             }
+            item.keys.for_each([&entry](const std::string& key, const Value& value)
+            {
+                entry[key] = value;
+            });
+        });
+        return config;
+    }
 
-            std::string key = line.substr(beg, sep - beg);
-            std::string value = line.substr(sep + 1, line.size() - 1);
+    template <typename = void>
+    bool save(const std::string& fileName, SaveFlags flags = SaveFlag_Default) const
+    {
+        return config().save(fileName, flags);
+    }
 
-            if (section.empty())
+private:
+    struct Item
+    {
+        bool section { false };
+        bool exists { false };
+        Value value;
+        utils::PersistentMap<Value> keys;
+    };
+
+    utils::PersistentMap<Item> m_entries;
+    size_t m_count { 0 };
+};
+
+// Configs and sections with equal fingerprints and counts are skipped unless
+// verify is set, which compares their keys too.
+template <typename R1, typename W1, typename R2, typename W2>
+std::vector<Change> diff(const ConfigImpl<R1, W1>& before, const ConfigImpl<R2, W2>& after, bool verify = false)
+{
+    std::vector<Change> changes;
+    if (!verify && before.fingerprint() == after.fingerprint() && before.count() == after.count())
+    {
+        return changes;
+    }
+    auto report = [&changes](ChangeType type, const std::string& name, const Entry<0>& entry)
+    {
+        if (!entry.section())
+        {
+            changes.push_back({type, std::string{}, name});
+            return;
+        }
+        for (const auto& kv : entry)
+        {
+            changes.push_back({type, name, kv.first});
+        }
+    };
+
+    using Element = std::pair<const std::string, Entry<0>>;
+    utils::merge_walk(before, after, [&](const Element* b, const Element* a)
+    {
+        if (b != nullptr && a != nullptr)
+        {
+            const Entry<0>& eb = b->second;
+            const Entry<0>& ea = a->second;
+            if (eb.section() && ea.section())
             {
-                config[key] = utils::Raw<>{value};
+                if (!verify && eb.fingerprint() == ea.fingerprint() && eb.count() == ea.count())
+                {
+                    return;
+                }
+                using Key = std::pair<const std::string, Entry<1>>;
+                utils::merge_walk(eb, ea, [&](const Key* kb, const Key* ka)
+                {
+                    if (kb == nullptr)
+                    {
+                        changes.push_back({Change_Added, a->first, ka->first});
+                    }
+                    else if (ka == nullptr)
+                    {
+                        changes.push_back({Change_Removed, b->first, kb->first});
+                    }
+                    else if (kb->second.raw() != ka->second.raw())
+                    {
+                        changes.push_back({Change_Modified, b->first, kb->first});
+                    }
+                });
+                return;
             }
-            else
+            if (!eb.section() && !ea.section())
             {
-                config[section][key] = utils::Raw<>{value};
+                if (eb.raw() != ea.raw())
+                {
+                    changes.push_back({Change_Modified, std::string{}, b->first});
+                }
+                return;
             }
         }
+        if (b != nullptr)
+        {
+            report(Change_Removed, b->first, b->second);
+        }
+        if (a != nullptr)
+        {
+            report(Change_Added, a->first, a->second);
+        }
+    });
+    return changes;
+}
 
-        return config;
-    }
+using Config = ConfigImpl<Reader<>, Writer<>>;
+using ConcurrentConfig = ConcurrentConfigImpl<Reader<>, Writer<>>;
+using PersistentConfig = PersistentConfigImpl<Reader<>, Writer<>>;
 
-private:
-    std::map<std::string, Entry<0>> m_entries;
-};
+// Compiled library mode: with SIMPLEINI_LIBRARY defined, the instantiations
+// below are declared extern, so translation units including this header do
+// not compile them again; they are compiled once by simpleini.cpp, which
+// defines SIMPLEINI_IMPLEMENTATION. Both must see the same SIMPLEINI_*
+// macros, which the simpleini CMake target exports.
+#if defined(SIMPLEINI_IMPLEMENTATION)
+#define SIMPLEINI_INSTANTIATE template
+#elif defined(SIMPLEINI_LIBRARY)
+#define SIMPLEINI_INSTANTIATE extern template
+#endif
 
-using Config = ConfigImpl<Reader<>, Writer<>>;
+#ifdef SIMPLEINI_INSTANTIATE
+namespace utils
+{
+    SIMPLEINI_INSTANTIATE std::string encode_text<void>(const std::string&);
+    SIMPLEINI_INSTANTIATE std::string decode_text<void>(const std::string&);
+    SIMPLEINI_INSTANTIATE std::string decode_text<void>(std::string&&);
+    SIMPLEINI_INSTANTIATE ArrayIndex index_array<void>(const std::string&);
+    SIMPLEINI_INSTANTIATE std::vector<std::string> splitArray<void>(const std::string&);
+
+    SIMPLEINI_INSTANTIATE std::string to_raw_value<bool>(bool, bool*);
+    SIMPLEINI_INSTANTIATE std::string to_raw_value<int>(int, int*);
+    SIMPLEINI_INSTANTIATE std::string to_raw_value<long>(long, long*);
+    SIMPLEINI_INSTANTIATE std::string to_raw_value<long long>(long long, long long*);
+    SIMPLEINI_INSTANTIATE std::string to_raw_value<unsigned>(unsigned, unsigned*);
+    SIMPLEINI_INSTANTIATE std::string to_raw_value<unsigned long>(unsigned long, unsigned long*);
+    SIMPLEINI_INSTANTIATE std::string to_raw_value<unsigned long long>(unsigned long long, unsigned long long*);
+    SIMPLEINI_INSTANTIATE std::string to_raw_value<float>(float, float*);
+    SIMPLEINI_INSTANTIATE std::string to_raw_value<double>(double, double*);
+
+    SIMPLEINI_INSTANTIATE bool from_raw_value<bool>(const std::string&);
+    SIMPLEINI_INSTANTIATE int from_raw_value<int>(const std::string&);
+    SIMPLEINI_INSTANTIATE long from_raw_value<long>(const std::string&);
+    SIMPLEINI_INSTANTIATE long long from_raw_value<long long>(const std::string&);
+    SIMPLEINI_INSTANTIATE unsigned from_raw_value<unsigned>(const std::string&);
+    SIMPLEINI_INSTANTIATE unsigned long from_raw_value<unsigned long>(const std::string&);
+    SIMPLEINI_INSTANTIATE unsigned long long from_raw_value<unsigned long long>(const std::string&);
+    SIMPLEINI_INSTANTIATE float from_raw_value<float>(const std::string&);
+    SIMPLEINI_INSTANTIATE double from_raw_value<double>(const std::string&);
+    SIMPLEINI_INSTANTIATE std::string from_raw_value<std::string>(const std::string&);
+
+    SIMPLEINI_INSTANTIATE std::vector<bool> from_raw_array<bool>(const std::string&);
+    SIMPLEINI_INSTANTIATE std::vector<int> from_raw_array<int>(const std::string&);
+    SIMPLEINI_INSTANTIATE std::vector<long> from_raw_array<long>(const std::string&);
+    SIMPLEINI_INSTANTIATE std::vector<long long> from_raw_array<long long>(const std::string&);
+    SIMPLEINI_INSTANTIATE std::vector<unsigned> from_raw_array<unsigned>(const std::string&);
+    SIMPLEINI_INSTANTIATE std::vector<unsigned long> from_raw_array<unsigned long>(const std::string&);
+    SIMPLEINI_INSTANTIATE std::vector<unsigned long long> from_raw_array<unsigned long long>(const std::string&);
+    SIMPLEINI_INSTANTIATE std::vector<float> from_raw_array<float>(const std::string&);
+    SIMPLEINI_INSTANTIATE std::vector<double> from_raw_array<double>(const std::string&);
+    SIMPLEINI_INSTANTIATE std::vector<std::string> from_raw_array<std::string>(const std::string&);
+}
+
+SIMPLEINI_INSTANTIATE class Reader<>;
+SIMPLEINI_INSTANTIATE class Writer<>;
+SIMPLEINI_INSTANTIATE class ConfigImpl<Reader<>, Writer<>>;
+
+// Member templates are not covered by the class instantiation.
+SIMPLEINI_INSTANTIATE Entry<0>& Config::operator[]<void>(const std::string&);
+SIMPLEINI_INSTANTIATE Entry<0>& Config::operator[]<void>(std::string&&);
+SIMPLEINI_INSTANTIATE void Config::merge<void>(Config&&);
+SIMPLEINI_INSTANTIATE void Config::merge<void>(const Config&);
+SIMPLEINI_INSTANTIATE bool Config::interpolate<void>();
+SIMPLEINI_INSTANTIATE std::vector<std::string> Config::children<void>(const std::string&) const;
+SIMPLEINI_INSTANTIATE bool Config::freeze<void>();
+SIMPLEINI_INSTANTIATE bool Config::freeze<void>(const std::string&);
+SIMPLEINI_INSTANTIATE const Value* Config::get<void>(utils::KeyView, utils::KeyView) const;
+SIMPLEINI_INSTANTIATE const Value* Config::get<void>(utils::KeyView) const;
+SIMPLEINI_INSTANTIATE void Config::memory_report<void>(std::ostream&) const;
+SIMPLEINI_INSTANTIATE void Config::compact<void>();
+SIMPLEINI_INSTANTIATE bool Config::save<void>(const std::string&, SaveFlags) const;
+SIMPLEINI_INSTANTIATE Config Config::load<void>(const std::string&, LoadFlags);
+SIMPLEINI_INSTANTIATE Config Config::load<void>(std::istream&, LoadFlags);
+SIMPLEINI_INSTANTIATE Config Config::load_from_buffer<void>(const char*, size_t, LoadFlags);
+SIMPLEINI_INSTANTIATE Config Config::load_directory<void>(const std::string&, const std::string&, unsigned, LoadFlags);
+
+#undef SIMPLEINI_INSTANTIATE
+#endif
 
+}
+
+namespace std
+{
+template <typename R, typename W>
+struct hash<simpleini::ConfigImpl<R, W>>
+{
+    size_t operator()(const simpleini::ConfigImpl<R, W>& config) const
+    {
+        return static_cast<size_t>(config.fingerprint());
+    }
+};
 }
 #endif // SIMPLEINI_H
@@ -0,0 +1,187 @@
+#include <atomic>
+#include <cstdlib>
+#include <iterator>
+#include <new>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "simpleini.h"
+
+//---------------------------------------------------------
+// Allocation counting
+//---------------------------------------------------------
+
+namespace
+{
+    std::atomic<size_t> allocations { 0 };
+
+    // Counts the allocations made by f.
+    template <typename F>
+    size_t count_allocations(F f)
+    {
+        size_t before = allocations.load();
+        f();
+        return allocations.load() - before;
+    }
+
+    std::string numbered_config(int sections, int keys)
+    {
+        std::string text;
+        for (int s = 0; s < sections; ++s)
+        {
+            text += "[section" + std::to_string(s) + "]\n";
+            for (int k = 0; k < keys; ++k)
+            {
+                text += "key" + std::to_string(k) + "=" + std::to_string(s * keys + k) + "\n";
+            }
+        }
+        return text;
+    }
+}
+
+// The replacements below pair malloc with free; GCC inlines them into callers
+// and then reports operator new memory released by free.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t size)
+{
+    ++allocations;
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+    {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+//---------------------------------------------------------
+// Budgets
+//---------------------------------------------------------
+
+TEST(Allocations, Load)
+{
+    const int sections { 10 };
+    const int keys { 100 };
+    auto text = numbered_config(sections, keys);
+    simpleini::Config config;
+    auto count = count_allocations([&]()
+    {
+        config = simpleini::Config::load_from_buffer(text.data(), text.size());
+    });
+    ASSERT_EQ(static_cast<size_t>(sections * keys), config.count());
+    // At most a map node per line, keys and values fitting in place.
+    EXPECT_LE(count, static_cast<size_t>(sections * (keys + 1)));
+}
+
+TEST(Allocations, Reads)
+{
+    auto text = numbered_config(10, 100);
+    auto config = simpleini::Config::load_from_buffer(text.data(), text.size());
+    config["section3"]["array"] = std::vector<int>{1, 2, 3, 4};
+    ASSERT_EQ(342, config["section3"]["key42"].value<int>());
+    ASSERT_EQ(2, config["section3"]["array"].array_at<int>(1));
+
+    EXPECT_EQ(0u, count_allocations([&]()
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            config["section3"]["key42"].value<int>();
+            config["section3"]["key42"].value<std::string>();
+            config["section3"]["array"].array_at<int>(i % 4);
+            config.get("section3", "key42");
+        }
+    }));
+    // Floating point values are read through std::istringstream, whose
+    // number parsing allocates a buffer.
+    EXPECT_LE(count_allocations([&]()
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            config["section3"]["key42"].value<double>();
+        }
+    }), 100u);
+    ASSERT_TRUE(config.freeze());
+    EXPECT_EQ(0u, count_allocations([&]()
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            config.get("section3", "key42")->value<int>();
+        }
+    }));
+}
+
+TEST(Allocations, Updates)
+{
+    auto text = numbered_config(10, 100);
+    auto config = simpleini::Config::load_from_buffer(text.data(), text.size());
+
+    EXPECT_EQ(0u, count_allocations([&]()
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            config["section3"]["key42"] = i;
+            config["section3"]["key42"] = 0.5;
+        }
+    }));
+
+    std::vector<std::string> names;
+    for (int i = 0; i < 100; ++i)
+    {
+        names.push_back("key" + std::to_string(i));
+    }
+    auto count = count_allocations([&]()
+    {
+        for (const auto& name : names)
+        {
+            config["new"][name] = 1;
+        }
+    });
+    // A map node per key and one for the section.
+    EXPECT_LE(count, names.size() + 1);
+
+    count = count_allocations([&]()
+    {
+        simpleini::Config copy = config;
+    });
+    // A map node per key and per section.
+    EXPECT_LE(count, config.count() + static_cast<size_t>(std::distance(config.begin(), config.end())));
+}
+
+#ifdef SIMPLEINI_STRING_VIEW
+TEST(Allocations, StringViews)
+{
+    simpleini::Config config;
+    const std::string section { "a section name too long to fit in place" };
+    const std::string key { "a key name which is too long to fit in place" };
+    config[section][key] = "a value which is too long to fit in place";
+    config[section]["escaped"] = "a value with an \"escape\" and too long to fit in place";
+    ASSERT_EQ("a value with an \"escape\" and too long to fit in place", config[section]["escaped"].value<std::string_view>());
+
+    std::string_view sectionView { section };
+    std::string_view keyView { key };
+    EXPECT_EQ(0u, count_allocations([&]()
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            config.get(sectionView, keyView)->value<std::string_view>();
+            config.find(sectionView)->second.find("escaped")->second.value<std::string_view>();
+        }
+    }));
+}
+#endif
@@ -0,0 +1,71 @@
+#include "simpleini.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Throughput of ConcurrentConfig with 1 to 64 threads, each reading keys of
+// random sections and updating one in ten of them.
+int main()
+{
+    const int sections { 1000 };
+    const int operations { 200000 };
+
+    simpleini::Config initial;
+    for (int s = 0; s < sections; ++s)
+    {
+        for (int k = 0; k < 5; ++k)
+        {
+            initial["section" + std::to_string(s)]["key" + std::to_string(k)] = s + k;
+        }
+    }
+    simpleini::ConcurrentConfig config { std::move(initial) };
+
+    std::vector<std::string> names;
+    for (int s = 0; s < sections; ++s)
+    {
+        names.push_back("section" + std::to_string(s));
+    }
+
+    std::printf("threads\tops/s\n");
+    for (unsigned threads = 1; threads <= 64; threads *= 2)
+    {
+        std::atomic<long> sum { 0 };
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]()
+            {
+                uint64_t state { 0x9e3779b97f4a7c15ull * (t + 1) };
+                long local { 0 };
+                for (int i = 0; i < operations / static_cast<int>(threads); ++i)
+                {
+                    state ^= state << 13;
+                    state ^= state >> 7;
+                    state ^= state << 17;
+                    const auto& section = names[state % sections];
+                    if (i % 10 == 0)
+                    {
+                        config.set(section, "key0", i);
+                    }
+                    else
+                    {
+                        local += config.value<int>(section, "key1");
+                    }
+                }
+                sum += local;
+            });
+        }
+        for (auto& w : workers)
+        {
+            w.join();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::printf("%u\t%.0f\n", threads, operations / elapsed.count());
+    }
+    return 0;
+}
@@ -0,0 +1,31 @@
+#include "simpleini.h"
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+
+// Uses the instantiations compiled into the simpleini library, so that a
+// mismatch between the library and its users fails to link.
+int main()
+{
+    const std::string text { "key=1\n[section]\nkey=2\n" };
+    auto config = simpleini::Config::load_from_buffer(text.data(), text.size());
+    std::istringstream input { text };
+    auto streamed = simpleini::Config::load(input);
+    config.merge(streamed);
+    config["section"]["other"] = 3;
+
+    const std::string section { "section" };
+    const std::string key { "key" };
+    if (!config.freeze() || config.get(section, key) == nullptr || config.get(key) == nullptr)
+    {
+        std::fprintf(stderr, "lookup failed\n");
+        return 1;
+    }
+    if (config.get(section, key)->value<int>() != 2 || config.count() != 3)
+    {
+        std::fprintf(stderr, "unexpected content\n");
+        return 1;
+    }
+    return 0;
+}
@@ -1,13 +1,26 @@
 #include "simpleini.h"
 #include "gtest/gtest.h"
 
+#include <cstdio>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <limits>
 #include <list>
+#include <map>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#if defined(_WIN32)
+#include <direct.h>
+#include <sys/utime.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
 
 class TestWriter;
 class TestReader;
@@ -233,6 +246,45 @@ TEST_F(Read, ArrayOfEmptyStrings)
     ASSERT_EQ(4, config["key"].array<int>().size());
 }
 
+TEST_F(Read, ArrayAt)
+{
+    file = {
+        R"(key=["a","b \"quoted, text\"",""])",
+        R"(numbers=[1,2,3])"
+    };
+    load();
+
+    ASSERT_EQ(3, config["key"].array_size());
+    ASSERT_EQ("a", config["key"].array_at<std::string>(0));
+    ASSERT_EQ("b \"quoted, text\"", config["key"].array_at<std::string>(1));
+    ASSERT_EQ("", config["key"].array_at<std::string>(2));
+    ASSERT_EQ("none", config["key"].array_at<std::string>(3, "none"));
+    ASSERT_EQ(3, config["numbers"].array_at<int>(2));
+
+    config["numbers"] = std::vector<int>{4, 5};
+    ASSERT_EQ(2, config["numbers"].array_size());
+    ASSERT_EQ(5, config["numbers"].array_at<int>(1));
+    ASSERT_EQ(0, config["numbers"].array_at<int>(2));
+}
+
+TEST_F(Read, NumericArrays)
+{
+    file = {
+        R"(ints=[1, -2 ,+3,,123456789012,0])",
+        R"(doubles=[0.1,-2.5e-3,1E22,12345678901234567.5,0.30000000000000004])",
+        R"(mixed=[1,"2",3x])"
+    };
+    load();
+
+    ASSERT_EQ((std::vector<int>{1, -2, 3, static_cast<int>(123456789012LL), 0}), config["ints"].array<int>());
+    ASSERT_EQ((std::vector<long long>{1, -2, 3, 123456789012LL, 0}), config["ints"].array<long long>());
+    ASSERT_EQ((std::vector<double>{0.1, -2.5e-3, 1e22, 12345678901234567.5, 0.30000000000000004}),
+        config["doubles"].array<double>());
+    ASSERT_EQ((std::vector<float>{0.1f, -2.5e-3f, 1e22f, 12345678901234567.5f, 0.30000000000000004f}),
+        config["doubles"].array<float>());
+    ASSERT_EQ((std::vector<int>{1, 0, 3}), config["mixed"].array<int>());
+}
+
 //---------------------------------------------------------
 // Write and read
 //---------------------------------------------------------
@@ -588,3 +640,676 @@ TEST_F(ReadWrite, ListAsArray)
     ASSERT_TRUE(compareArrays(out, output["key"].array<std::string>()));
     ASSERT_TRUE(compareArrays(out, output["section"]["key"].array<std::string>()));
 }
+
+TEST_F(ReadWrite, NativeArray)
+{
+    std::vector<double> weights(SIMPLEINI_NATIVE_ARRAY_SIZE);
+    for (size_t i = 0; i < weights.size(); ++i)
+    {
+        weights[i] = i * 0.5;
+    }
+    config["section"]["weights"] = weights;
+    config["section"]["small"] = std::vector<double>{1.5};
+
+    auto native = config["section"]["weights"].native<double>();
+    ASSERT_NE(nullptr, native);
+    ASSERT_EQ(weights, *native);
+    ASSERT_EQ(native, config["section"]["weights"].native<double>());
+    ASSERT_EQ(nullptr, config["section"]["weights"].native<float>());
+    ASSERT_EQ(nullptr, config["section"]["small"].native<double>());
+    ASSERT_EQ(weights.size(), config["section"]["weights"].array_size());
+    ASSERT_EQ(2.5, config["section"]["weights"].array_at<double>(5));
+    ASSERT_EQ(2, config["section"]["weights"].array_at<int>(5));
+    ASSERT_EQ(weights, config["section"]["weights"].array<double>());
+
+    Config copy = config;
+    ASSERT_EQ(config.fingerprint(), copy.fingerprint());
+    copy["section"]["weights"] = std::vector<double>(weights.size());
+    ASSERT_NE(config.fingerprint(), copy.fingerprint());
+
+    // Native arrays hash their elements, not their text.
+    auto fingerprint = config.fingerprint();
+    writeAndRead(simpleini::SaveFlag_Default);
+    ASSERT_NE(fingerprint, output.fingerprint());
+    ASSERT_EQ(nullptr, output["section"]["weights"].native<double>());
+    ASSERT_EQ(weights, output["section"]["weights"].array<double>());
+    ASSERT_EQ(std::vector<double>{1.5}, output["section"]["small"].array<double>());
+}
+
+TEST_F(ReadWrite, Fingerprint)
+{
+    config["key"] = 1;
+    config["text"] = std::string{"a\tb"};
+    config["section"]["key"] = std::vector<int>{1, 2, 3};
+    auto fingerprint = config.fingerprint();
+    writeAndRead(simpleini::SaveFlag_Default);
+    ASSERT_EQ(fingerprint, output.fingerprint());
+}
+
+//---------------------------------------------------------
+// Handles
+//---------------------------------------------------------
+
+TEST_F(Read, Handle_ReadsCurrentValue)
+{
+    file = {
+        "key=1",
+        "[section]",
+        "key=2"
+    };
+    load();
+
+    auto key = config.handle("key");
+    auto sectionKey = config.handle("section", "key");
+    ASSERT_EQ(1, key.value<int>());
+    ASSERT_EQ(2, sectionKey.value<int>());
+
+    config["section"]["key"] = 3;
+    ASSERT_EQ(3, sectionKey.value<int>());
+}
+
+TEST_F(Read, Handle_SurvivesReload)
+{
+    file = {
+        "[section]",
+        "key=1"
+    };
+    load();
+    auto handle = config.handle("section", "key");
+
+    file = {
+        "[section]",
+        "key=10",
+        "other=20"
+    };
+    load();
+    ASSERT_EQ(10, handle.value<int>());
+
+    file = {};
+    load();
+    ASSERT_TRUE(handle.empty());
+    ASSERT_EQ(-1, handle.value<int>(-1));
+    ASSERT_EQ(0u, config.count());
+    ASSERT_TRUE(config.find("section") == config.end());
+
+    file = {
+        "[section]",
+        "key=30"
+    };
+    config = Config::load("");
+    ASSERT_EQ(30, handle.value<int>());
+}
+
+TEST_F(Read, Handle_SurvivesCopyAssignment)
+{
+    file = {
+        "key=1"
+    };
+    load();
+    auto handle = config.handle("key");
+
+    Config other;
+    other["key"] = 2;
+    config = other;
+    other["key"] = 3;
+    ASSERT_EQ(2, handle.value<int>());
+}
+
+TEST(Handle, DoesNotInsert)
+{
+    simpleini::Config config;
+    config["plain"] = 5;
+    auto missing = config.handle("section", "key");
+    auto inPlain = config.handle("plain", "key");
+    ASSERT_TRUE(missing.empty());
+    ASSERT_TRUE(inPlain.empty());
+    ASSERT_FALSE(config["plain"].section());
+    ASSERT_EQ(5, config["plain"].value<int>());
+    ASSERT_EQ(1u, config.count());
+
+    config["section"]["key"] = 1;
+    ASSERT_EQ(1, missing.value<int>());
+    config["section"].clear();
+    ASSERT_TRUE(missing.empty());
+    config["section"]["key"] = 2;
+    ASSERT_EQ(2, missing.value<int>());
+}
+
+TEST(Handle, OutlivesConfig)
+{
+    simpleini::Handle handle;
+    {
+        simpleini::Config config;
+        config["key"] = 1;
+        handle = config.handle("key");
+        ASSERT_EQ(1, handle.value<int>());
+    }
+    ASSERT_TRUE(handle.empty());
+    ASSERT_EQ(-1, handle.value<int>(-1));
+}
+
+TEST(Handle, Default)
+{
+    simpleini::Handle handle;
+    ASSERT_FALSE(handle.valid());
+    ASSERT_TRUE(handle.empty());
+    ASSERT_EQ(5, handle.value<int>(5));
+}
+
+//---------------------------------------------------------
+// Asynchronous load
+//---------------------------------------------------------
+
+TEST_F(Read, LoadAsync)
+{
+    file = {
+        "key=1",
+        "[section]",
+        "key=2"
+    };
+    auto future = Config::load_async("");
+    auto result = future.get();
+
+    ASSERT_EQ(1, result["key"].value<int>());
+    ASSERT_EQ(2, result["section"]["key"].value<int>());
+}
+
+TEST_F(Read, LoadAsync_Executor)
+{
+    file = {
+        "key=1"
+    };
+    std::vector<std::function<void()>> queue;
+    int value { 0 };
+    Config::load_async("", [&queue](std::function<void()> task)
+    {
+        queue.push_back(std::move(task));
+    }, [&value](Config&& loaded)
+    {
+        value = loaded["key"].value<int>();
+    });
+
+    ASSERT_EQ(1, queue.size());
+    ASSERT_EQ(0, value);
+    queue.front()();
+    ASSERT_EQ(1, value);
+}
+
+TEST_F(Read, LoadAllAsync)
+{
+    file = {
+        "key=1"
+    };
+    auto futures = Config::load_all_async({"a", "b", "c"});
+
+    ASSERT_EQ(3, futures.size());
+    for (auto& future : futures)
+    {
+        ASSERT_EQ(1, future.get()["key"].value<int>());
+    }
+}
+
+TEST_F(Read, LoadAllAsyncBounded)
+{
+    file = {
+        "key=1"
+    };
+    auto futures = Config::load_all_async(std::vector<std::string>(50, "a"), 2);
+
+    ASSERT_EQ(50, futures.size());
+    for (auto& future : futures)
+    {
+        ASSERT_EQ(1, future.get()["key"].value<int>());
+    }
+}
+
+TEST_F(Read, LoadAllAsyncDropped)
+{
+    file = {
+        "key=1"
+    };
+    // Dropping the futures waits for the workers.
+    Config::load_all_async(std::vector<std::string>(20, "a"), 3);
+    auto futures = Config::load_all_async(std::vector<std::string>(7, "a"), 3);
+    futures.clear();
+}
+
+//---------------------------------------------------------
+// Load from memory
+//---------------------------------------------------------
+
+TEST(Load, FromBuffer)
+{
+    const std::string text {
+        "# comment\n"
+        "key=1\n"
+        "\n"
+        "[section]\n"
+        "  key=\"text\"\n"
+        "last=2"
+    };
+    auto config = simpleini::Config::load_from_buffer(text.data(), text.size());
+
+    ASSERT_EQ(3, config.count());
+    ASSERT_EQ(1, config["key"].value<int>());
+    ASSERT_EQ("text", config["section"]["key"].value<std::string>());
+    ASSERT_EQ(2, config["section"]["last"].value<int>());
+}
+
+TEST(Load, FromEmptyBuffer)
+{
+    auto config = simpleini::Config::load_from_buffer("", 0);
+    ASSERT_EQ(0, config.count());
+}
+
+TEST(Load, FromStream)
+{
+    std::istringstream iss {
+        "key=1\n"
+        "[section]\n"
+        "key=[1,2,3]\n"
+    };
+    auto config = simpleini::Config::load(iss);
+
+    ASSERT_EQ(2, config.count());
+    ASSERT_EQ(1, config["key"].value<int>());
+    ASSERT_EQ(3, config["section"]["key"].array<int>().size());
+}
+
+//---------------------------------------------------------
+// File reader
+//---------------------------------------------------------
+
+class FileReader : public testing::Test
+{
+protected:
+    std::string fileName { "simpleini-reader-test.ini" };
+
+    void write(const std::string& text)
+    {
+        std::ofstream out { fileName, std::ios::trunc };
+        out << text;
+    }
+
+    std::vector<std::string> lines(size_t blockSize)
+    {
+        simpleini::Reader<> reader { fileName, blockSize };
+        std::vector<std::string> out;
+        std::string line;
+        while (reader.getLine(line))
+        {
+            out.push_back(line);
+        }
+        return out;
+    }
+
+    void TearDown() override
+    {
+        std::remove(fileName.c_str());
+    }
+};
+
+TEST_F(FileReader, SplitsLinesAcrossBlocks)
+{
+    write("a=1\nlong_key_spanning_blocks=2\n\nlast=3");
+    std::vector<std::string> expected { {"a=1", "long_key_spanning_blocks=2", "", "last=3"} };
+    ASSERT_EQ(expected, lines(1));
+    ASSERT_EQ(expected, lines(4));
+    ASSERT_EQ(expected, lines(1024));
+}
+
+TEST_F(FileReader, TrailingNewline)
+{
+    write("a=1\n");
+    ASSERT_EQ(std::vector<std::string>{"a=1"}, lines(1024));
+}
+
+TEST_F(FileReader, MissingFile)
+{
+    ASSERT_TRUE(lines(1024).empty());
+    ASSERT_EQ(0, simpleini::Config::load(fileName).count());
+}
+
+TEST_F(FileReader, Load)
+{
+    simpleini::Config config;
+    config["key"] = 1;
+    config["section"]["key"] = std::string{"text"};
+    ASSERT_TRUE(config.save(fileName));
+
+    auto loaded = simpleini::Config::load(fileName);
+    ASSERT_EQ(1, loaded["key"].value<int>());
+    ASSERT_EQ("text", loaded["section"]["key"].value<std::string>());
+}
+
+class Directory : public testing::Test
+{
+protected:
+    const std::string directory { "simpleini-conf.d" };
+    std::vector<std::string> files;
+
+    void SetUp() override
+    {
+#if defined(_WIN32)
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+    }
+
+    void write(const std::string& name, const std::string& text)
+    {
+        files.push_back(directory + "/" + name);
+        std::ofstream out { files.back(), std::ios::trunc };
+        out << text;
+    }
+
+    // Moves the modification time of a written file a minute back.
+    void age(const std::string& name)
+    {
+        auto path = directory + "/" + name;
+        struct stat info;
+        ASSERT_EQ(0, stat(path.c_str(), &info));
+        utimbuf times;
+        times.actime = info.st_atime - 60;
+        times.modtime = info.st_mtime - 60;
+        ASSERT_EQ(0, utime(path.c_str(), &times));
+    }
+
+    void TearDown() override
+    {
+        for (const auto& file : files)
+        {
+            std::remove(file.c_str());
+        }
+        std::remove(directory.c_str());
+    }
+};
+
+TEST_F(Directory, MergesInFileNameOrder)
+{
+    write("20-override.ini", "key=2\n[section]\nb=20\n");
+    write("10-base.ini", "key=1\nbase=1\n[section]\na=10\nb=10\n");
+    write("30-last.ini", "[section]\nb=30\n[other]\nc=1\n");
+    write("ignored.txt", "key=100\n");
+
+    for (unsigned threads : {1u, 2u, 0u})
+    {
+        auto config = simpleini::Config::load_directory(directory, "*.ini", threads);
+        ASSERT_EQ(5, config.count());
+        ASSERT_EQ(2, config["key"].value<int>());
+        ASSERT_EQ(1, config["base"].value<int>());
+        ASSERT_EQ(10, config["section"]["a"].value<int>());
+        ASSERT_EQ(30, config["section"]["b"].value<int>());
+        ASSERT_EQ(1, config["other"]["c"].value<int>());
+    }
+}
+
+TEST_F(Directory, Missing)
+{
+    ASSERT_EQ(0, simpleini::Config::load_directory("simpleini-missing.d").count());
+}
+
+struct CountingReader : simpleini::Reader<>
+{
+    CountingReader(const std::string& name)
+        : simpleini::Reader<>{name}
+    {
+        ++opened()[name.substr(name.find_last_of('/') + 1)];
+    }
+
+    static std::map<std::string, int>& opened()
+    {
+        static std::map<std::string, int> counts;
+        return counts;
+    }
+};
+
+TEST_F(Read, Interpolation)
+{
+    file = {"[base]", "port=8000", "[server]", "port=${base:port}", "url=http://host:${server:port}"};
+    load();
+    ASSERT_TRUE(config.interpolate());
+    ASSERT_EQ(8000, config["server"]["port"].value<int>());
+    ASSERT_EQ("http://host:8000", config["server"]["url"].value<std::string>());
+}
+
+TEST_F(ReadWrite, Interpolation)
+{
+    config["dir"] = "/var";
+    config["section"]["log"] = "${dir}/log";
+    ASSERT_TRUE(config.interpolate());
+    ASSERT_EQ("/var/log", config["section"]["log"].value<std::string>());
+
+    writeAndRead(simpleini::SaveFlag_Default);
+    ASSERT_EQ("${dir}/log", output["section"]["log"].value<std::string>());
+    ASSERT_TRUE(output.interpolate());
+    ASSERT_EQ("/var/log", output["section"]["log"].value<std::string>());
+}
+
+TEST_F(ReadWrite, Parallel)
+{
+    config["top"] = 1;
+    config["empty"] = "";
+    for (int i = 0; i < 200; ++i)
+    {
+        auto& section = config["section" + std::to_string(i)];
+        for (int k = 0; k < i % 7; ++k)
+        {
+            section["key" + std::to_string(k)] = k % 3 ? std::to_string(i * k) : "";
+        }
+    }
+    config["section5"]["array"] = std::vector<double>(3 * SIMPLEINI_NATIVE_ARRAY_SIZE, 0.5);
+
+    for (auto flags : {simpleini::SaveFlag_Default, simpleini::SaveFlag_SkipEmptyKeys})
+    {
+        TestWriter::output.str("");
+        config.save("", flags);
+        auto sequential = TestWriter::output.str();
+        TestWriter::output.str("");
+        config.save("", flags | simpleini::SaveFlag_Parallel);
+        ASSERT_EQ(sequential, TestWriter::output.str());
+    }
+
+    writeAndRead(simpleini::SaveFlag_Parallel);
+    ASSERT_EQ(1, output["top"].value<int>());
+    ASSERT_EQ("24", output["section6"]["key4"].value<std::string>());
+    ASSERT_EQ(3 * SIMPLEINI_NATIVE_ARRAY_SIZE, output["section5"]["array"].array<double>().size());
+}
+
+#if !defined(_WIN32)
+TEST_F(Directory, SkipsSubdirectories)
+{
+    using Counting = simpleini::ConfigImpl<CountingReader, simpleini::Writer<>>;
+    write("10-base.ini", "key=1\n");
+    files.push_back(directory + "/20-sub.ini");
+    mkdir(files.back().c_str(), 0755);
+
+    CountingReader::opened().clear();
+    auto config = Counting::load_directory(directory);
+    ASSERT_EQ(1, config["key"].value<int>());
+    ASSERT_EQ(1, CountingReader::opened()["10-base.ini"]);
+    ASSERT_EQ(0, CountingReader::opened().count("20-sub.ini"));
+}
+#endif
+
+TEST_F(Directory, Include)
+{
+    write("common.ini", "shared=1\n[common]\na=1\n");
+    write("main.ini", "key=1\n[section]\nlocal=1\n@include common.ini\nafter=1\n");
+
+    auto config = simpleini::Config::load(directory + "/main.ini", simpleini::LoadFlag_Includes);
+    ASSERT_EQ(1, config["key"].value<int>());
+    ASSERT_EQ(1, config["section"]["shared"].value<int>());
+    ASSERT_EQ(1, config["section"]["local"].value<int>());
+    ASSERT_EQ(1, config["section"]["after"].value<int>());
+    ASSERT_EQ(1, config["common"]["a"].value<int>());
+    ASSERT_TRUE(config.find("shared") == config.end());
+}
+
+TEST_F(Directory, IncludeParsedOnce)
+{
+    using Counting = simpleini::ConfigImpl<CountingReader, simpleini::Writer<>>;
+    write("shared.ini", "[shared]\nvalue=1\n");
+    write("first.ini", "@include \"shared.ini\"\n");
+    write("second.ini", "@include shared.ini\n");
+    age("shared.ini");
+
+    CountingReader::opened().clear();
+    ASSERT_EQ(1, Counting::load(directory + "/first.ini", simpleini::LoadFlag_Includes)["shared"]["value"].value<int>());
+    ASSERT_EQ(1, Counting::load(directory + "/second.ini", simpleini::LoadFlag_Includes)["shared"]["value"].value<int>());
+    ASSERT_EQ(1, CountingReader::opened()["shared.ini"]);
+
+    write("shared.ini", "[shared]\nvalue=22\n");
+    ASSERT_EQ(22, Counting::load(directory + "/first.ini", simpleini::LoadFlag_Includes)["shared"]["value"].value<int>());
+    ASSERT_EQ(2, CountingReader::opened()["shared.ini"]);
+
+    // Same size, likely the same modification time: recently modified files
+    // are read again.
+    write("shared.ini", "[shared]\nvalue=33\n");
+    ASSERT_EQ(33, Counting::load(directory + "/first.ini", simpleini::LoadFlag_Includes)["shared"]["value"].value<int>());
+    ASSERT_EQ(3, CountingReader::opened()["shared.ini"]);
+}
+
+TEST_F(Directory, IncludesAreOptIn)
+{
+    write("common.ini", "shared=1\n");
+    write("main.ini", "key=1\n@include common.ini\n");
+
+    auto config = simpleini::Config::load(directory + "/main.ini");
+    ASSERT_EQ(1, config.count());
+    ASSERT_TRUE(config.find("shared") == config.end());
+
+    std::string text { "@include " + directory + "/common.ini\n" };
+    ASSERT_EQ(0, simpleini::Config::load_from_buffer(text.data(), text.size()).count());
+    std::istringstream input { text };
+    ASSERT_EQ(0, simpleini::Config::load(input).count());
+    auto included = simpleini::Config::load_from_buffer(text.data(), text.size(), simpleini::LoadFlag_Includes);
+    ASSERT_EQ(1, included["shared"].value<int>());
+}
+
+TEST_F(Directory, IncludesAsync)
+{
+    write("common.ini", "shared=1\n");
+    write("main.ini", "key=1\n@include common.ini\n");
+    const std::string main { directory + "/main.ini" };
+
+    ASSERT_EQ(1, simpleini::Config::load_async(main, simpleini::LoadFlag_Includes).get()["shared"].value<int>());
+    ASSERT_EQ(1, simpleini::Config::load_async(main).get().count());
+
+    auto futures = simpleini::Config::load_all_async({main, main, main}, 2, simpleini::LoadFlag_Includes);
+    ASSERT_EQ(3, futures.size());
+    for (auto& future : futures)
+    {
+        ASSERT_EQ(1, future.get()["shared"].value<int>());
+    }
+
+    int shared = 0;
+    simpleini::Config::load_async(main, [](std::function<void()> task) { task(); },
+        [&shared](simpleini::Config&& config) { shared = config["shared"].value<int>(); },
+        simpleini::LoadFlag_Includes);
+    ASSERT_EQ(1, shared);
+}
+
+TEST_F(Directory, IncludeCycle)
+{
+    write("a.ini", "a=1\n@include b.ini\n");
+    write("b.ini", "b=1\n@include a.ini\n@include missing.ini\n");
+
+    auto config = simpleini::Config::load(directory + "/a.ini", simpleini::LoadFlag_Includes);
+    ASSERT_EQ(1, config["a"].value<int>());
+    ASSERT_EQ(1, config["b"].value<int>());
+    ASSERT_EQ(2, config.count());
+}
+
+TEST(Merge, OverridesKeys)
+{
+    simpleini::Config base;
+    base["key"] = 1;
+    base["section"]["a"] = 1;
+    base["section"]["b"] = 1;
+
+    simpleini::Config update;
+    update["key"] = 2;
+    update["section"]["b"] = 2;
+    update["section"]["c"] = 2;
+
+    base.merge(update);
+    ASSERT_EQ(2, base["key"].value<int>());
+    ASSERT_EQ(1, base["section"]["a"].value<int>());
+    ASSERT_EQ(2, base["section"]["b"].value<int>());
+    ASSERT_EQ(2, base["section"]["c"].value<int>());
+    ASSERT_EQ(2, update["section"]["c"].value<int>());
+
+    base.merge(std::move(update));
+    ASSERT_EQ(4, base.count());
+}
+
+#if defined(SIMPLEINI_WITH_ZLIB) || defined(SIMPLEINI_WITH_ZSTD)
+void compressedRoundTrip(const std::string& fileName)
+{
+    simpleini::Config config;
+    config["key"] = 1;
+    for (int i = 0; i < 20000; ++i)
+    {
+        config["section"]["key_" + std::to_string(i)] = i;
+    }
+    ASSERT_TRUE(config.save(fileName));
+
+    std::ifstream in { fileName, std::ios::binary };
+    std::string head(2, '\0');
+    in.read(&head[0], 2);
+    ASSERT_NE("ke", head);
+
+    auto loaded = simpleini::Config::load(fileName);
+    ASSERT_EQ(config.count(), loaded.count());
+    ASSERT_EQ(1, loaded["key"].value<int>());
+    ASSERT_EQ(19999, loaded["section"]["key_19999"].value<int>());
+}
+#endif
+
+#ifdef SIMPLEINI_WITH_ZLIB
+TEST_F(FileReader, Gzip)
+{
+    fileName += ".gz";
+    compressedRoundTrip(fileName);
+}
+#endif
+
+#ifdef SIMPLEINI_WITH_ZSTD
+TEST_F(FileReader, Zstd)
+{
+    fileName += ".zst";
+    compressedRoundTrip(fileName);
+}
+#endif
+
+#if defined(__linux__)
+void failingSave(const std::string& fileName)
+{
+    simpleini::Config config;
+    for (int i = 0; i < 20000; ++i)
+    {
+        config["section"]["key_" + std::to_string(i)] = i;
+    }
+    ASSERT_FALSE(config.save(fileName));
+}
+
+TEST(WriteErrors, DeviceFull)
+{
+    failingSave("/dev/full");
+}
+
+#if defined(SIMPLEINI_WITH_ZLIB) || defined(SIMPLEINI_WITH_ZSTD)
+TEST(WriteErrors, CompressedDeviceFull)
+{
+    for (const std::string extension : { ".gz", ".zst" })
+    {
+        const std::string fileName { "simpleini-full" + extension };
+        ASSERT_EQ(0, symlink("/dev/full", fileName.c_str()));
+        failingSave(fileName);
+        std::remove(fileName.c_str());
+    }
+}
+#endif
+#endif
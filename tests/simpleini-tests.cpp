@@ -1,4 +1,8 @@
+#include <algorithm>
+#include <iterator>
 #include <limits>
+#include <sstream>
+#include <thread>
 
 #include "gtest/gtest.h"
 #include "simpleini.h"
@@ -49,6 +53,27 @@ TEST(Key, DefaultValue)
     ASSERT_EQ(-1, value.value<int>(-1));
 }
 
+TEST(Key, Take)
+{
+    simpleini::Config config;
+    std::string text { "a \"quoted\"\ttext\n" };
+    config["key"] = text;
+    config["section"]["key"] = 10;
+    ASSERT_EQ(text, config["key"].take<std::string>());
+    ASSERT_TRUE(config["key"].empty());
+    ASSERT_EQ(10, config["section"]["key"].take<int>());
+    ASSERT_TRUE(config["section"]["key"].empty());
+    ASSERT_EQ(-1, config["section"]["key"].take<int>(-1));
+}
+
+TEST(Key, MovedString)
+{
+    simpleini::Config config;
+    std::string text { "text" };
+    config["key"] = std::move(text);
+    ASSERT_EQ("text", config["key"].value<std::string>());
+}
+
 //---------------------------------------------------------
 // Section
 //---------------------------------------------------------
@@ -94,6 +119,26 @@ TEST(Section, IsNotSection)
     ASSERT_EQ(false, config["not_section"].section());
 }
 
+TEST(Section, AssignFromEntry)
+{
+    simpleini::Config config;
+    config["b"]["k"] = 1;
+    config["b"]["l"] = 2;
+    config["a"] = config["b"];
+    ASSERT_TRUE(config["a"].section());
+    ASSERT_EQ(2u, config["a"].count());
+    ASSERT_EQ(1, config.get("a", "k")->value<int>());
+    ASSERT_EQ(4u, config.count());
+
+    config["c"] = 3;
+    config["a"] = config["c"];
+    ASSERT_FALSE(config["a"].section());
+    ASSERT_EQ(3, config["a"].value<int>());
+
+    config["b"]["m"] = config["b"]["l"];
+    ASSERT_EQ(2, config["b"]["m"].value<int>());
+}
+
 //---------------------------------------------------------
 // Config
 //---------------------------------------------------------
@@ -115,3 +160,742 @@ TEST(Config, CountEmpty)
     simpleini::Config config;
     ASSERT_EQ(0, config.count());
 }
+
+//---------------------------------------------------------
+// Access tracking
+//---------------------------------------------------------
+
+#ifdef SIMPLEINI_ACCESS_TRACKING
+TEST(AccessTracking, CountsReads)
+{
+    simpleini::Config config;
+    config["key"] = 1;
+    config["section"]["hot"] = 2;
+    config["section"]["dead"] = 3;
+    for (int i = 0; i < 5; ++i)
+    {
+        (void)config["section"]["hot"].value<int>();
+    }
+    (void)config["key"].value<int>();
+    ASSERT_EQ(5, config["section"]["hot"].reads());
+    ASSERT_EQ(1, config["key"].reads());
+    ASSERT_EQ(0, config["section"]["dead"].reads());
+}
+
+TEST(AccessTracking, StatsSortedByReads)
+{
+    simpleini::Config config;
+    config["key"] = 1;
+    config["section"]["hot"] = 2;
+    config["section"]["dead"] = 3;
+    (void)config["section"]["hot"].array<int>();
+    (void)config["section"]["hot"].value<int>();
+    (void)config["key"].value<int>();
+
+    auto stats = config.access_stats();
+    ASSERT_EQ(3, stats.size());
+    ASSERT_EQ("section", stats[0].section);
+    ASSERT_EQ("hot", stats[0].key);
+    ASSERT_EQ(2, stats[0].reads);
+    ASSERT_EQ("", stats[1].section);
+    ASSERT_EQ("key", stats[1].key);
+    ASSERT_EQ(1, stats[1].reads);
+    ASSERT_EQ("dead", stats[2].key);
+    ASSERT_EQ(0, stats[2].reads);
+
+    std::ostringstream oss;
+    config.access_report(oss);
+    ASSERT_EQ("2\t[section] hot\n1\tkey\n0\t[section] dead\n", oss.str());
+}
+
+TEST(AccessTracking, Reset)
+{
+    simpleini::Config config;
+    config["key"] = 1;
+    (void)config["key"].value<int>();
+    config.reset_access_stats();
+    ASSERT_EQ(0, config["key"].reads());
+}
+#endif
+
+//---------------------------------------------------------
+// Queries
+//---------------------------------------------------------
+
+TEST(Query, Prefix)
+{
+    simpleini::Config config;
+    config["route.a"] = 1;
+    config["route.b"] = 2;
+    config["router"] = 3;
+    config["rout"] = 4;
+    config["section"]["route.x"] = 5;
+    config["section"]["other"] = 6;
+
+    std::vector<std::string> names;
+    for (const auto& e : config.prefix("route."))
+    {
+        names.push_back(e.first);
+    }
+    ASSERT_EQ((std::vector<std::string>{"route.a", "route.b"}), names);
+
+    names.clear();
+    for (const auto& e : config["section"].prefix("route."))
+    {
+        names.push_back(e.first);
+    }
+    ASSERT_EQ(std::vector<std::string>{"route.x"}, names);
+
+    ASSERT_TRUE(config.prefix("none").empty());
+    ASSERT_EQ(5, std::distance(config.prefix("").begin(), config.prefix("").end()));
+}
+
+TEST(Query, Glob)
+{
+    simpleini::Config config;
+    config["route.a.port"] = 1;
+    config["route.b.port"] = 2;
+    config["route.b.host"] = 3;
+    config["other.port"] = 4;
+
+    auto matches = config.glob("route.*.port");
+    ASSERT_EQ(2, matches.size());
+    ASSERT_EQ("route.a.port", matches[0]->first);
+    ASSERT_EQ("route.b.port", matches[1]->first);
+
+    ASSERT_EQ(3, config.glob("*.port").size());
+    ASSERT_EQ(1, config.glob("route.?.host").size());
+    ASSERT_EQ(4, config.glob("*").size());
+    ASSERT_EQ(0, config.glob("route").size());
+}
+
+TEST(Query, Children)
+{
+    simpleini::Config config;
+    config["a"]["key"] = 1;
+    config["a.b"]["key"] = 1;
+    config["a.b.c"]["key"] = 1;
+    config["a.b-c"]["key"] = 1;
+    config["a.d.e.f"]["key"] = 1;
+    config["x"]["key"] = 1;
+    config["a.key"] = 1;
+
+    ASSERT_EQ((std::vector<std::string>{"a", "x"}), config.children());
+    ASSERT_EQ((std::vector<std::string>{"a.b", "a.b-c", "a.d"}), config.children("a"));
+    ASSERT_EQ(std::vector<std::string>{"a.b.c"}, config.children("a.b"));
+    ASSERT_EQ(std::vector<std::string>{"a.d.e"}, config.children("a.d"));
+    ASSERT_TRUE(config.children("x").empty());
+}
+
+//---------------------------------------------------------
+// Diff
+//---------------------------------------------------------
+
+TEST(Diff, Identical)
+{
+    simpleini::Config a;
+    a["key"] = 1;
+    a["section"]["key"] = 2;
+    simpleini::Config b = a;
+    ASSERT_TRUE(simpleini::diff(a, b).empty());
+    ASSERT_TRUE(simpleini::diff(a, b, true).empty());
+
+    b["section"]["key"] = 3;
+    ASSERT_EQ(1u, simpleini::diff(a, b, true).size());
+}
+
+TEST(Diff, Changes)
+{
+    simpleini::Config a;
+    a["same"] = 1;
+    a["modified"] = 1;
+    a["removed"] = 1;
+    a["section"]["same"] = 1;
+    a["section"]["modified"] = 1;
+    a["section"]["removed"] = 1;
+    a["removed_section"]["key"] = 1;
+
+    simpleini::Config b;
+    b["same"] = 1;
+    b["modified"] = 2;
+    b["added"] = 2;
+    b["section"]["same"] = 1;
+    b["section"]["modified"] = 2;
+    b["section"]["added"] = 2;
+    b["added_section"]["key"] = 2;
+
+    std::vector<std::string> text;
+    for (const auto& change : simpleini::diff(a, b))
+    {
+        const char* type = change.type == simpleini::Change_Added ? "+" : change.type == simpleini::Change_Removed ? "-" : "~";
+        text.push_back(type + change.section + "/" + change.key);
+    }
+    std::vector<std::string> expected {
+        "+/added",
+        "+added_section/key",
+        "~/modified",
+        "-/removed",
+        "-removed_section/key",
+        "+section/added",
+        "~section/modified",
+        "-section/removed"
+    };
+    ASSERT_EQ(expected, text);
+}
+
+TEST(Diff, KeyBecomesSection)
+{
+    simpleini::Config a;
+    a["name"] = 1;
+    simpleini::Config b;
+    b["name"]["key"] = 1;
+
+    auto changes = simpleini::diff(a, b);
+    ASSERT_EQ(2, changes.size());
+    ASSERT_EQ(simpleini::Change_Removed, changes[0].type);
+    ASSERT_EQ("", changes[0].section);
+    ASSERT_EQ(simpleini::Change_Added, changes[1].type);
+    ASSERT_EQ("name", changes[1].section);
+}
+
+TEST(Diff, Equality)
+{
+    simpleini::Config a;
+    a["key"] = 1;
+    a["section"]["key"] = 2;
+    simpleini::Config b = a;
+    ASSERT_TRUE(a == b);
+
+    b["section"]["key"] = 3;
+    ASSERT_TRUE(a != b);
+    b["section"]["key"] = 2;
+    ASSERT_TRUE(a == b);
+
+    b["other"]["key"] = 1;
+    ASSERT_FALSE(a == b);
+}
+
+TEST(Fingerprint, TracksSectionContent)
+{
+    simpleini::Config config;
+    config["section"]["a"] = 1;
+    config["section"]["b"] = 2;
+    auto initial = config["section"].fingerprint();
+
+    config["section"]["a"] = 3;
+    ASSERT_NE(initial, config["section"].fingerprint());
+    config["section"]["a"] = 1;
+    ASSERT_EQ(initial, config["section"].fingerprint());
+
+    simpleini::Config other;
+    other["section"]["b"] = 2;
+    other["section"]["a"] = 1;
+    ASSERT_EQ(initial, other["section"].fingerprint());
+
+    other["section"]["c"];
+    ASSERT_NE(initial, other["section"].fingerprint());
+}
+
+TEST(Fingerprint, TracksConfigContent)
+{
+    simpleini::Config a;
+    a["key"] = 1;
+    a["section"]["a"] = 1;
+    a["section"]["b"] = 2;
+
+    simpleini::Config b;
+    b["section"]["b"] = 2;
+    b["section"]["a"] = 1;
+    b["key"] = 1;
+    ASSERT_EQ(a.fingerprint(), b.fingerprint());
+    ASSERT_TRUE(a == b);
+
+    b["section"]["b"] = 3;
+    ASSERT_NE(a.fingerprint(), b.fingerprint());
+    ASSERT_TRUE(a != b);
+    b["section"]["b"] = 2;
+    ASSERT_TRUE(a == b);
+
+    b["key"] = 2;
+    ASSERT_TRUE(a != b);
+    b["key"].clear();
+    b["key"] = 1;
+    ASSERT_TRUE(a == b);
+
+    b["section"].clear();
+    ASSERT_TRUE(a != b);
+}
+
+TEST(Fingerprint, CopiedAndMovedConfigs)
+{
+    simpleini::Config a;
+    a["key"] = 1;
+    a["section"]["a"] = 1;
+    auto fingerprint = a.fingerprint();
+
+    simpleini::Config b = a;
+    ASSERT_EQ(fingerprint, b.fingerprint());
+    b["section"]["a"] = 2;
+    ASSERT_EQ(fingerprint, a.fingerprint());
+
+    simpleini::Config c = std::move(b);
+    ASSERT_EQ(0, b.fingerprint());
+    c["section"]["a"] = 1;
+    ASSERT_EQ(fingerprint, c.fingerprint());
+
+    simpleini::Config d;
+    d = c;
+    d["section"]["a"] = 2;
+    d = std::move(c);
+    ASSERT_EQ(fingerprint, d.fingerprint());
+    ASSERT_EQ(fingerprint, std::hash<simpleini::Config>{}(d));
+}
+
+TEST(Interpolation, Resolves)
+{
+    simpleini::Config config;
+    config["root"] = "/opt";
+    config["paths"]["bin"] = "${paths:home}/bin";
+    config["paths"]["home"] = "${root}/app";
+    config["paths"]["missing"] = "[${nothing:here}]";
+    config["paths"]["plain"] = "$HOME";
+
+    ASSERT_TRUE(config.interpolate());
+    ASSERT_EQ("/opt/app/bin", config["paths"]["bin"].value<std::string>());
+    ASSERT_EQ("/opt/app", config["paths"]["home"].value<std::string>());
+    ASSERT_EQ("[]", config["paths"]["missing"].value<std::string>());
+    ASSERT_EQ("$HOME", config["paths"]["plain"].value<std::string>());
+}
+
+TEST(Interpolation, Cycle)
+{
+    simpleini::Config config;
+    config["s"]["a"] = "${s:b}";
+    config["s"]["b"] = "x${s:a}";
+    config["s"]["c"] = "${s:d}!";
+    config["s"]["d"] = "d";
+
+    ASSERT_FALSE(config.interpolate());
+    ASSERT_EQ("${s:b}", config["s"]["a"].value<std::string>());
+    ASSERT_EQ("x${s:a}", config["s"]["b"].value<std::string>());
+    ASSERT_EQ("d!", config["s"]["c"].value<std::string>());
+}
+
+TEST(Interpolation, ReresolvesDependents)
+{
+    simpleini::Config config;
+    config["host"] = "localhost";
+    config["db"]["url"] = "${db:scheme}://${host}:${db:port}";
+    config["db"]["scheme"] = "pg";
+    config["db"]["port"] = 5432;
+    config["log"]["target"] = "${db:url}/log";
+    ASSERT_TRUE(config.interpolate());
+    ASSERT_EQ("pg://localhost:5432/log", config["log"]["target"].value<std::string>());
+
+    config["host"] = "example.org";
+    ASSERT_EQ("pg://example.org:5432", config["db"]["url"].value<std::string>());
+    ASSERT_EQ("pg://example.org:5432/log", config["log"]["target"].value<std::string>());
+
+    config["db"]["url"] = "${db:scheme}://remote";
+    ASSERT_EQ("pg://remote/log", config["log"]["target"].value<std::string>());
+
+    config["db"]["url"] = "plain";
+    config["db"]["scheme"] = "mysql";
+    ASSERT_EQ("plain", config["db"]["url"].value<std::string>());
+    ASSERT_EQ("plain/log", config["log"]["target"].value<std::string>());
+
+    simpleini::Config copy = config;
+    copy["db"]["url"] = "${db:scheme}";
+    ASSERT_EQ("mysql/log", copy["log"]["target"].value<std::string>());
+    ASSERT_EQ("plain/log", config["log"]["target"].value<std::string>());
+}
+
+size_t countKeys(const simpleini::Config& config)
+{
+    size_t count { 0 };
+    for (const auto& e : config)
+    {
+        count += e.second.count();
+    }
+    return count;
+}
+
+TEST(Count, MaintainedOnUpdates)
+{
+    simpleini::Config config;
+    config["a"] = 1;
+    config["b"];
+    config["section"]["x"] = 1;
+    config["section"]["y"] = 2;
+    ASSERT_EQ(4, config.count());
+
+    config["a"]["z"] = 3;
+    ASSERT_EQ(4, config.count());
+    config["section"] = 5;
+    ASSERT_EQ(3, config.count());
+    config["section"]["w"] = 1;
+    ASSERT_EQ(5, config.count());
+    config["a"].clear();
+    ASSERT_EQ(4, config.count());
+    simpleini::Entry<0> section = config["section"];
+    config["b"] = std::move(section);
+    ASSERT_EQ(6, config.count());
+    ASSERT_EQ(countKeys(config), config.count());
+
+    simpleini::Config copy = config;
+    copy["new"] = 1;
+    ASSERT_EQ(7, copy.count());
+    ASSERT_EQ(6, config.count());
+    config = std::move(copy);
+    ASSERT_EQ(7, config.count());
+    ASSERT_EQ(countKeys(config), config.count());
+}
+
+TEST(Memory, UsageAndCompact)
+{
+    simpleini::Value large;
+    large = std::string(200, 'x');
+    simpleini::Value small;
+    small = std::string(20, 'y');
+
+    simpleini::Config config;
+    for (int i = 0; i < 100; ++i)
+    {
+        auto& section = config["section_" + std::to_string(i)];
+        for (int j = 0; j < 10; ++j)
+        {
+            section["key_" + std::to_string(j)] = large;
+            section["key_" + std::to_string(j)] = small;
+        }
+    }
+    auto handle = config.handle("section_5", "key_5");
+    auto fingerprint = config.fingerprint();
+
+    auto before = config.memory_usage();
+    ASSERT_GT(before.values, 1000u * 200);
+    ASSERT_GT(before.overhead, 0u);
+    ASSERT_EQ(before.total(), before.keys + before.values + before.overhead);
+
+    config.compact();
+    auto after = config.memory_usage();
+    ASSERT_LT(after.values, before.values / 4);
+    ASSERT_EQ(before.overhead, after.overhead);
+    ASSERT_EQ(fingerprint, config.fingerprint());
+    ASSERT_EQ(1000, config.count());
+    ASSERT_EQ(std::string(20, 'y'), handle.value<std::string>());
+
+    config["section_5"]["key_5"] = "z";
+    ASSERT_EQ("z", handle.value<std::string>());
+
+    std::ostringstream report;
+    config.memory_report(report);
+    auto text = report.str();
+    ASSERT_EQ(100, std::count(text.begin(), text.end(), '\n'));
+    ASSERT_NE(std::string::npos, text.find("\t[section_5]\n"));
+}
+
+TEST(Section, IteratorsSurviveInserts)
+{
+    std::vector<std::string> keys;
+    for (int i = 0; i < 24; ++i)
+    {
+        keys.push_back("key_" + std::to_string((i * 7) % 24 + 10));
+    }
+
+    simpleini::Config config;
+    auto& section = config["section"];
+    std::vector<const simpleini::Entry<1>*> refs;
+    std::vector<simpleini::Entry<0>::iterator> iterators;
+    for (const auto& key : keys)
+    {
+        section[key] = key;
+        refs.push_back(&section[key]);
+        iterators.push_back(section.find(key));
+    }
+    ASSERT_EQ(keys.size(), section.count());
+
+    std::vector<std::string> sorted = keys;
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<std::string> iterated;
+    for (const auto& kv : section)
+    {
+        iterated.push_back(kv.first);
+        ASSERT_EQ(kv.first, kv.second.value<std::string>());
+    }
+    ASSERT_EQ(sorted, iterated);
+
+    std::vector<std::string> reversed;
+    for (auto it = section.end(); it != section.begin();)
+    {
+        reversed.push_back((--it)->first);
+    }
+    ASSERT_TRUE(std::equal(sorted.rbegin(), sorted.rend(), reversed.begin()));
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        ASSERT_EQ(refs[i], &section[keys[i]]);
+        ASSERT_EQ(keys[i], iterators[i]->first);
+        ASSERT_EQ(refs[i], &iterators[i]->second);
+    }
+    ASSERT_TRUE(section.find("key_") == section.end());
+
+    auto range = section.prefix("key_1");
+    ASSERT_EQ(10, std::distance(range.begin(), range.end()));
+
+    const simpleini::Config copy = config;
+    ASSERT_EQ(static_cast<std::ptrdiff_t>(keys.size()), std::distance(copy.find("section")->second.begin(), copy.find("section")->second.end()));
+    ASSERT_EQ(config.fingerprint(), copy.fingerprint());
+}
+
+TEST(Freeze, Lookups)
+{
+    simpleini::Config config;
+    config["top"] = 1;
+    for (int s = 0; s < 20; ++s)
+    {
+        auto& section = config["section" + std::to_string(s)];
+        for (int k = 0; k < s; ++k)
+        {
+            section["key" + std::to_string(k)] = s * 100 + k;
+        }
+    }
+    ASSERT_FALSE(config.frozen());
+    ASSERT_EQ(1, config.get("top")->value<int>());
+    ASSERT_TRUE(config.freeze());
+    ASSERT_TRUE(config.frozen());
+
+    ASSERT_EQ(1, config.get("top")->value<int>());
+    for (int s = 0; s < 20; ++s)
+    {
+        for (int k = 0; k < s; ++k)
+        {
+            auto value = config.get("section" + std::to_string(s), "key" + std::to_string(k));
+            ASSERT_TRUE(value != nullptr);
+            ASSERT_EQ(s * 100 + k, value->value<int>());
+        }
+        ASSERT_EQ(nullptr, config.get("section" + std::to_string(s), "key" + std::to_string(s)));
+    }
+    ASSERT_EQ(nullptr, config.get("missing"));
+    ASSERT_EQ(nullptr, config.get("section1"));
+    ASSERT_EQ(nullptr, config.get("top", "key0"));
+
+    config["section3"]["key1"] = 42;
+    ASSERT_TRUE(config.frozen());
+    ASSERT_EQ(42, config.get("section3", "key1")->value<int>());
+
+    const simpleini::Config copy = config;
+    ASSERT_TRUE(copy.frozen());
+    ASSERT_EQ(42, copy.get("section3", "key1")->value<int>());
+    ASSERT_NE(config.get("section3", "key1"), copy.get("section3", "key1"));
+
+    config["section3"]["new"] = 1;
+    ASSERT_FALSE(config.frozen());
+    ASSERT_EQ(1, config.get("section3", "new")->value<int>());
+    config = copy;
+    config["top"]["key"] = 1;
+    ASSERT_FALSE(config.frozen());
+    ASSERT_EQ(nullptr, config.get("top"));
+}
+
+TEST(Freeze, SectionReplaced)
+{
+    simpleini::Config config;
+    config["a"]["k"] = 1;
+    config["b"]["k"] = 2;
+    config["c"]["k"] = 3;
+    auto handle = config.handle("a", "k");
+    ASSERT_TRUE(config.freeze());
+
+    config["a"] = simpleini::Entry<0>{config["b"]};
+    ASSERT_FALSE(config.frozen());
+    ASSERT_EQ(2, config.get("a", "k")->value<int>());
+    ASSERT_EQ(2, handle.value<int>());
+
+    ASSERT_TRUE(config.freeze());
+    simpleini::Entry<0> moved { config["c"] };
+    config["a"] = std::move(moved);
+    ASSERT_FALSE(config.frozen());
+    ASSERT_EQ(3, config.get("a", "k")->value<int>());
+    ASSERT_EQ(3, handle.value<int>());
+
+    ASSERT_TRUE(config.freeze());
+    config["a"].clear();
+    ASSERT_FALSE(config.frozen());
+    ASSERT_EQ(nullptr, config.get("a", "k"));
+}
+
+TEST(Freeze, SerializedIndex)
+{
+    simpleini::Config config;
+    for (int i = 0; i < 1000; ++i)
+    {
+        config["section" + std::to_string(i % 10)]["key" + std::to_string(i)] = i;
+    }
+    ASSERT_EQ("", config.frozen_index());
+    ASSERT_TRUE(config.freeze());
+    auto index = config.frozen_index();
+
+    simpleini::Config other;
+    ASSERT_FALSE(other.freeze(index));
+    for (int i = 999; i >= 0; --i)
+    {
+        other["section" + std::to_string(i % 10)]["key" + std::to_string(i)] = i;
+    }
+    ASSERT_FALSE(other.freeze(index.substr(0, index.size() - 1)));
+    ASSERT_TRUE(other.freeze(index));
+    for (int i = 0; i < 1000; ++i)
+    {
+        ASSERT_EQ(i, other.get("section" + std::to_string(i % 10), "key" + std::to_string(i))->value<int>());
+    }
+    other["section0"]["key1"] = 1;
+    ASSERT_FALSE(other.freeze(index));
+}
+
+struct alignas(64) CacheLine
+{
+    int value { 7 };
+};
+
+TEST(Concurrent, AlignedShards)
+{
+    for (size_t size = 1; size < 50; ++size)
+    {
+        simpleini::utils::AlignedArray<CacheLine> lines { size };
+        ASSERT_EQ(size, lines.size());
+        ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(lines.begin()) % 64);
+        ASSERT_EQ(7, lines[size - 1].value);
+    }
+}
+
+TEST(Concurrent, ReadersAndWriters)
+{
+    simpleini::Config initial;
+    initial["name"] = "config";
+    initial["shared"]["counter"] = 0;
+    simpleini::ConcurrentConfig config { std::move(initial), 8 };
+    ASSERT_EQ("config", config.value<std::string>("name"));
+    ASSERT_EQ(0, config.value<int>("shared", "counter", -1));
+    ASSERT_EQ(-1, config.value<int>("shared", "missing", -1));
+
+    const int threads { 4 };
+    const int updates { 2000 };
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&config, t]()
+        {
+            const std::string section { "section" + std::to_string(t) };
+            for (int i = 0; i < updates; ++i)
+            {
+                config.set(section, "value", i);
+                config.update("shared", [](simpleini::Entry<0>& shared)
+                {
+                    shared["counter"] = shared["counter"].value<int>() + 1;
+                });
+                int seen = config.value<int>(section, "value", -1);
+                EXPECT_EQ(i, seen);
+                config.read("section" + std::to_string((t + 1) % threads), [](const simpleini::Entry<0>* other)
+                {
+                    EXPECT_TRUE(other == nullptr || other->section());
+                });
+            }
+        });
+    }
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+
+    ASSERT_EQ(threads * updates, config.value<int>("shared", "counter"));
+    ASSERT_TRUE(config.contains("section0", "value"));
+    ASSERT_FALSE(config.contains("section0", "missing"));
+    ASSERT_EQ(2 + threads, config.count());
+    auto snapshot = config.snapshot();
+    ASSERT_EQ(2 + threads, snapshot.count());
+    ASSERT_EQ(updates - 1, snapshot["section3"]["value"].value<int>());
+}
+
+TEST(Persistent, VersionsShareUnchangedKeys)
+{
+    simpleini::Config config;
+    config["name"] = "base";
+    for (int i = 0; i < 100; ++i)
+    {
+        config["section" + std::to_string(i % 10)]["key" + std::to_string(i)] = i;
+    }
+    const simpleini::PersistentConfig base { config };
+    ASSERT_EQ(config.count(), base.count());
+    ASSERT_EQ("base", base.value<std::string>("name"));
+    ASSERT_EQ(42, base.value<int>("section2", "key42"));
+    ASSERT_EQ(-1, base.value<int>("section2", "key43", -1));
+    ASSERT_EQ(nullptr, base.get("section2"));
+    ASSERT_EQ(nullptr, base.get("name", "key"));
+
+    std::vector<simpleini::PersistentConfig> versions { base };
+    for (int i = 0; i < 100; ++i)
+    {
+        versions.push_back(versions.back());
+        versions.back().set("section" + std::to_string(i % 10), "key" + std::to_string(i), -i);
+    }
+    versions.back().set("section0", "added", true).set("name", "last");
+
+    for (int i = 0; i < 100; ++i)
+    {
+        const auto section = "section" + std::to_string(i % 10);
+        const auto key = "key" + std::to_string(i);
+        ASSERT_EQ(i, base.value<int>(section, key));
+        ASSERT_EQ(i, versions[i].value<int>(section, key));
+        ASSERT_EQ(-i, versions[i + 1].value<int>(section, key));
+        ASSERT_EQ(base.get(section, key), versions[i].get(section, key));
+    }
+    ASSERT_EQ("base", base.value<std::string>("name"));
+    ASSERT_EQ("last", versions.back().value<std::string>("name"));
+    ASSERT_FALSE(base.contains("section0", "added"));
+    ASSERT_EQ(base.count() + 1, versions.back().count());
+
+    auto last = versions.back();
+    last.set("section0", "x", 1).set("name", "y", 2).set("section1", 3);
+    ASSERT_EQ(versions.back().count() + 2 - 10, last.count());
+    ASSERT_EQ(2, last.value<int>("name", "y"));
+    ASSERT_EQ(nullptr, last.get("name"));
+    ASSERT_EQ(3, last.value<int>("section1"));
+
+    auto saved = versions.back().config();
+    ASSERT_EQ(versions.back().count(), saved.count());
+    ASSERT_EQ(true, saved["section0"]["added"].value<bool>());
+    ASSERT_EQ(-99, saved["section9"]["key99"].value<int>());
+    ASSERT_EQ(simpleini::PersistentConfig{saved}.config().fingerprint(), saved.fingerprint());
+}
+
+#ifdef SIMPLEINI_STRING_VIEW
+TEST(StringView, ValuesAndLookups)
+{
+    simpleini::Config config;
+    config["section"]["plain"] = "a value long enough not to fit in place";
+    config["section"]["escaped"] = "line\nbreak";
+    config["section"]["number"] = 10;
+    config["key"] = "top";
+
+    const auto& section = config["section"];
+    auto plain = section.find(std::string_view{"plain"})->second.value<std::string_view>();
+    ASSERT_EQ("a value long enough not to fit in place", plain);
+    ASSERT_EQ("line\nbreak", section.find("escaped")->second.value<std::string_view>());
+    ASSERT_EQ("10", section.find("number")->second.value<std::string_view>());
+    ASSERT_EQ("default", config["section"]["missing"].value<std::string_view>("default"));
+
+    std::string_view name { "section.plain" };
+    auto value = config.get(name.substr(0, 7), name.substr(8));
+    ASSERT_TRUE(value != nullptr);
+    ASSERT_EQ(plain.data(), value->value<std::string_view>().data());
+    ASSERT_EQ("top", config.get(std::string_view{"key"})->value<std::string_view>());
+    ASSERT_TRUE(config.find(std::string_view{"section"}) != config.end());
+    ASSERT_TRUE(config.freeze());
+    ASSERT_EQ(value, config.get(name.substr(0, 7), name.substr(8)));
+
+    config["section"]["escaped"] = "tab\there";
+    ASSERT_EQ("tab\there", config.get("section", "escaped")->value<std::string_view>());
+
+    const simpleini::PersistentConfig version { config };
+    ASSERT_EQ("top", version.value<std::string_view>(std::string_view{"key"}));
+}
+#endif